@@ -18,15 +18,6 @@
 
 #include "Math.h"
 
-static long long drand48_x = 0x1234ABCD330E;
-
-STATIC_INLINE void srand48(int x) { drand48_x = x ^ (x << 16); }
-
-STATIC_INLINE double drand48() {
-    drand48_x = drand48_x * 0x5DEECE66D + 0xB;
-    return (drand48_x & 0xFFFFFFFFFFFF) * (1.0 / 281474976710656.0);
-}
-
 #ifdef _MSC_VER
 __declspec(align(16))
 #endif
@@ -167,7 +158,7 @@ STATIC_INLINE void orthoBasis(vec basis[3], const vec& n) {
 }
 
 STATIC_INLINE float ambient_occlusion(Isect& isect, Plane& plane,
-                                      Sphere spheres[3]) {
+                                      Sphere spheres[3], PsimRand& rng) {
     float eps = 0.0001f;
     vec p, n;
     vec basis[3];
@@ -184,8 +175,8 @@ STATIC_INLINE float ambient_occlusion(Isect& isect, Plane& plane,
             Ray ray;
             Isect occIsect;
 
-            float theta = sqrtf(drand48());
-            float phi = 2.0f * M_PI * drand48();
+            float theta = sqrtf(psim_rand_float(rng));
+            float phi = 2.0f * M_PI * psim_rand_float(rng);
             float x = cosf(phi) * theta;
             float y = sinf(phi) * theta;
             float z = sqrtf(1.0f - theta * theta);
@@ -225,12 +216,12 @@ STATIC_INLINE void ao_scanlines(int y0, int y1, int w, int h, int nsubsamples,
                                 {vec(-0.5f, 0.0f, -3.0f), 0.5f},
                                 {vec(1.0f, 0.0f, -2.2f), 0.5f}};
 
-    srand48(y0);
     float invSamples = 1.f / nsubsamples;
     for (int y = y0; y < y1; ++y) {
 #psim num_spmd_threads(w) gang_size(16)
         {
             uint64_t x = psim_get_thread_num();
+            PsimRand rng = psim_rand_init(y);
             int offset = 3 * (y * w + x);
             for (int u = 0; u < nsubsamples; ++u) {
                 for (int v = 0; v < nsubsamples; ++v) {
@@ -263,7 +254,7 @@ STATIC_INLINE void ao_scanlines(int y0, int y1, int w, int h, int nsubsamples,
                     ray_plane_intersect(isect, ray, plane);
 
                     if (isect.hit)
-                        ret = ambient_occlusion(isect, plane, spheres);
+                        ret = ambient_occlusion(isect, plane, spheres, rng);
 
                     // Update image for AO for this ray
                     image[offset] += ret;
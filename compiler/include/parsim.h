@@ -11,8 +11,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "psim_grid.h"
+#include "psim_tune.h"
 
 #define PSIM_WARNINGS_ON                                         \
     {                                                                \
@@ -31,6 +37,8 @@ extern "C" void __psim_set_grid_size(uint64_t grid_size) noexcept;
 extern "C" void __psim_set_gang_num(uint64_t grid_num) noexcept;
 extern "C" void __psim_set_gang_size(unsigned gang_size) noexcept;
 extern "C" void __psim_set_grid_sub_name(const char* subname) noexcept;
+extern "C" void __psim_set_prefetch_distance(unsigned distance) noexcept;
+extern "C" void __psim_set_math_accuracy(unsigned accuracy) noexcept;
 
 extern "C" unsigned psim_get_lane_num() noexcept;
 extern "C" uint64_t psim_get_gang_num() noexcept;
@@ -89,5 +97,256 @@ T1 psim_unzip_sync(T2 a, uint32_t index) noexcept
 
 void psim_gang_sync() noexcept __attribute__((convergent));
 
+/* warp-vote style operations over the active lanes of the gang; the result
+ * is the same for all lanes. psim_ballot_sync returns the 64-bit word 'word'
+ * of the bitmap of the lanes whose predicate is true. */
+uint64_t psim_ballot_sync(bool pred, unsigned word = 0) noexcept
+    __attribute__((convergent));
+bool psim_any_sync(bool pred) noexcept __attribute__((convergent));
+bool psim_all_sync(bool pred) noexcept __attribute__((convergent));
+unsigned psim_popc_sync(bool pred) noexcept __attribute__((convergent));
+unsigned psim_first_active_lane() noexcept __attribute__((convergent));
+
+/* stream compaction: the active lanes store/load consecutive elements at ptr,
+ * in lane order. psim_compress_store returns the number of elements stored. */
+template <typename T>
+unsigned psim_compress_store(T* ptr, T value) noexcept
+    __attribute__((convergent));
+
+template <typename T>
+T psim_expand_load(const T* ptr) noexcept __attribute__((convergent));
+
+/* non-temporal stores: the packed stores of whole gangs through the pointer
+ * returned by psim_nontemporal, or by psim_store_stream, bypass the caches.
+ * "#psim nontemporal(ptr)" applies psim_nontemporal to ptr in the region and
+ * calls psim_stream_fence once per thread that ran gangs of the region. */
+template <typename T>
+T* psim_nontemporal(T* ptr) noexcept;
+
+template <typename T>
+inline __attribute__((always_inline)) void psim_store_stream(T* ptr,
+                                                             T value) noexcept {
+    __builtin_nontemporal_store(value, ptr);
+}
+
+inline void psim_stream_fence() noexcept {
+#if defined(__SSE__)
+    __builtin_ia32_sfence();
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/*
+ * Counter-based random numbers. The n-th number drawn by a thread is a
+ * SplitMix64 hash of the seed, of the stream of the thread and of n, so that
+ * the sequences do not depend on the gang size or on the order of the gangs,
+ * and no state is shared between the threads. These functions are inlined
+ * into the SPMD region, where they become vector integer operations.
+ */
+struct PsimRand {
+    uint64_t key;
+    uint64_t counter;
+};
+
+inline __attribute__((always_inline)) uint64_t __psim_rand_mix64(
+    uint64_t z) noexcept {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* 'seed' should be uniform; 'stream' defaults to psim_get_thread_num() */
+inline __attribute__((always_inline)) PsimRand psim_rand_init(
+    uint64_t seed, uint64_t stream) noexcept {
+    PsimRand rng;
+    rng.key = __psim_rand_mix64(seed ^ __psim_rand_mix64(stream));
+    rng.counter = 0;
+    return rng;
+}
+
+inline __attribute__((always_inline)) PsimRand psim_rand_init(
+    uint64_t seed) noexcept {
+    return psim_rand_init(seed, psim_get_thread_num());
+}
+
+inline __attribute__((always_inline)) uint64_t psim_rand_u64(
+    PsimRand& rng) noexcept {
+    rng.counter++;
+    return __psim_rand_mix64(rng.key + rng.counter * 0x9E3779B97F4A7C15ull);
+}
+
+inline __attribute__((always_inline)) uint32_t psim_rand_u32(
+    PsimRand& rng) noexcept {
+    return (uint32_t)(psim_rand_u64(rng) >> 32);
+}
+
+/* uniform in [0, 1) */
+inline __attribute__((always_inline)) float psim_rand_float(
+    PsimRand& rng) noexcept {
+    return (int32_t)(psim_rand_u32(rng) >> 8) * 0x1.0p-24f;
+}
+
+inline __attribute__((always_inline)) double psim_rand_double(
+    PsimRand& rng) noexcept {
+    return (int64_t)(psim_rand_u64(rng) >> 11) * 0x1.0p-53;
+}
+
 template <typename T1, typename T2>
 void psim_atomic_add_local(T1* a, T2 value) noexcept;
+
+/* gang-wide reductions */
+enum PsimReduceOp {
+    PSIM_REDUCE_ADD,
+    PSIM_REDUCE_MIN,
+    PSIM_REDUCE_MAX,
+    PSIM_REDUCE_AND,
+    PSIM_REDUCE_OR,
+};
+
+/*
+ * Reduction accumulator declared outside the SPMD region. Inside the region,
+ * psim_reduce_*_sync() combines the value of every active lane into N_ARCH
+ * partial results, lane-wise; the horizontal reduction is only done once by
+ * Reduce(), outside the region.
+ *
+ * Floating-point additions are only split into partial sums when REASSOC is
+ * set. Otherwise every gang is added in lane order to a single partial sum,
+ * which gives the same result as the sequential loop.
+ */
+template <typename T, PsimReduceOp OP, bool REASSOC = false>
+struct PsimReduction {
+    typedef T value_type;
+    static constexpr const bool ORDERED =
+        std::is_floating_point<T>::value && OP == PSIM_REDUCE_ADD && !REASSOC;
+    static constexpr const int N_ARCH = ORDERED ? 1 : 64 / sizeof(T);
+    typedef T vty __attribute__((vector_size(N_ARCH * sizeof(T))));
+    vty var;
+
+  public:
+    PsimReduction() noexcept {
+        for (int i = 0; i < N_ARCH; i++) {
+            var[i] = Identity();
+        }
+    }
+
+    static T Identity() noexcept {
+        if constexpr (OP == PSIM_REDUCE_MIN) {
+            return std::numeric_limits<T>::has_infinity
+                       ? std::numeric_limits<T>::infinity()
+                       : std::numeric_limits<T>::max();
+        } else if constexpr (OP == PSIM_REDUCE_MAX) {
+            return std::numeric_limits<T>::has_infinity
+                       ? -std::numeric_limits<T>::infinity()
+                       : std::numeric_limits<T>::lowest();
+        } else if constexpr (OP == PSIM_REDUCE_AND) {
+            return (T)~(T)0;
+        } else {
+            return 0;
+        }
+    }
+
+    static T Combine(T a, T b) noexcept {
+        if constexpr (OP == PSIM_REDUCE_MIN) {
+            return b < a ? b : a;
+        } else if constexpr (OP == PSIM_REDUCE_MAX) {
+            return b > a ? b : a;
+        } else if constexpr (OP == PSIM_REDUCE_AND) {
+            return a & b;
+        } else if constexpr (OP == PSIM_REDUCE_OR) {
+            return a | b;
+        } else {
+            return a + b;
+        }
+    }
+
+    T Reduce() const noexcept {
+        T ret = var[0];
+        for (int i = 1; i < N_ARCH; i++) {
+            ret = Combine(ret, var[i]);
+        }
+        return ret;
+    }
+};
+
+template <typename T, bool REASSOC = false>
+using PsimReduceAdd = PsimReduction<T, PSIM_REDUCE_ADD, REASSOC>;
+template <typename T>
+using PsimReduceMin = PsimReduction<T, PSIM_REDUCE_MIN>;
+template <typename T>
+using PsimReduceMax = PsimReduction<T, PSIM_REDUCE_MAX>;
+template <typename T>
+using PsimReduceAnd = PsimReduction<T, PSIM_REDUCE_AND>;
+template <typename T>
+using PsimReduceOr = PsimReduction<T, PSIM_REDUCE_OR>;
+
+template <typename T, bool REASSOC>
+void psim_reduce_add_sync(
+    PsimReduction<T, PSIM_REDUCE_ADD, REASSOC>& acc,
+    typename PsimReduction<T, PSIM_REDUCE_ADD, REASSOC>::value_type
+        value) noexcept __attribute__((convergent));
+template <typename T, bool REASSOC>
+void psim_reduce_min_sync(
+    PsimReduction<T, PSIM_REDUCE_MIN, REASSOC>& acc,
+    typename PsimReduction<T, PSIM_REDUCE_MIN, REASSOC>::value_type
+        value) noexcept __attribute__((convergent));
+template <typename T, bool REASSOC>
+void psim_reduce_max_sync(
+    PsimReduction<T, PSIM_REDUCE_MAX, REASSOC>& acc,
+    typename PsimReduction<T, PSIM_REDUCE_MAX, REASSOC>::value_type
+        value) noexcept __attribute__((convergent));
+template <typename T, bool REASSOC>
+void psim_reduce_and_sync(
+    PsimReduction<T, PSIM_REDUCE_AND, REASSOC>& acc,
+    typename PsimReduction<T, PSIM_REDUCE_AND, REASSOC>::value_type
+        value) noexcept __attribute__((convergent));
+template <typename T, bool REASSOC>
+void psim_reduce_or_sync(
+    PsimReduction<T, PSIM_REDUCE_OR, REASSOC>& acc,
+    typename PsimReduction<T, PSIM_REDUCE_OR, REASSOC>::value_type
+        value) noexcept __attribute__((convergent));
+
+/*
+ * Gang-wide prefix scans. Every lane gets the combination of the values of
+ * the lanes below it (exclusive) or up to and including it (inclusive).
+ * Inactive lanes contribute the identity of the operation.
+ *
+ * The overloads taking a PsimScanCarry declared outside the SPMD region
+ * continue the scan across gangs: the carry holds the combination of all the
+ * previous gangs. They are only meaningful when gangs run in order, i.e. not
+ * in "#psim parallel" regions.
+ */
+template <typename T, PsimReduceOp OP = PSIM_REDUCE_ADD>
+struct PsimScanCarry {
+    typedef T value_type;
+    T carry = PsimReduction<T, OP>::Identity();
+
+  public:
+    T Get() const noexcept { return carry; }
+};
+
+template <typename T>
+T psim_scan_add_sync(T value, bool inclusive) noexcept
+    __attribute__((convergent));
+template <typename T>
+T psim_scan_min_sync(T value, bool inclusive) noexcept
+    __attribute__((convergent));
+template <typename T>
+T psim_scan_max_sync(T value, bool inclusive) noexcept
+    __attribute__((convergent));
+
+template <typename T>
+T psim_scan_add_sync(
+    PsimScanCarry<T, PSIM_REDUCE_ADD>& carry,
+    typename PsimScanCarry<T, PSIM_REDUCE_ADD>::value_type value,
+    bool inclusive) noexcept __attribute__((convergent));
+template <typename T>
+T psim_scan_min_sync(
+    PsimScanCarry<T, PSIM_REDUCE_MIN>& carry,
+    typename PsimScanCarry<T, PSIM_REDUCE_MIN>::value_type value,
+    bool inclusive) noexcept __attribute__((convergent));
+template <typename T>
+T psim_scan_max_sync(
+    PsimScanCarry<T, PSIM_REDUCE_MAX>& carry,
+    typename PsimScanCarry<T, PSIM_REDUCE_MAX>::value_type value,
+    bool inclusive) noexcept __attribute__((convergent));
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/*
+ * Grid scheduler runtime used by "#psim parallel" regions.
+ *
+ * The parsimony front-end launches the gangs of a parallel region through
+ * __psim_grid_launch(). Gangs are distributed over a persistent pool of worker
+ * threads. Every worker owns a contiguous range of gangs and consumes it from
+ * the front; idle workers steal the upper half of the range of another worker.
+ *
+ *   static:  each worker runs its initial range, no stealing
+ *   dynamic: workers claim "chunk" gangs at a time and steal when idle
+ *   guided:  workers claim half of their remaining range (at least "chunk")
+ *            and steal when idle
+ *
+ * The number of workers is read from PSIM_NUM_THREADS, then OMP_NUM_THREADS,
+ * and defaults to std::thread::hardware_concurrency().
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// defined in parsim.h
+inline void psim_stream_fence() noexcept;
+
+enum PsimSchedule {
+    PSIM_SCHEDULE_STATIC,
+    PSIM_SCHEDULE_DYNAMIC,
+    PSIM_SCHEDULE_GUIDED
+};
+
+class PsimGridScheduler {
+  public:
+    typedef void (*GangFunc)(void* ctx, uint64_t gang);
+
+    static PsimGridScheduler& instance() {
+        static PsimGridScheduler scheduler;
+        return scheduler;
+    }
+
+    unsigned getNumWorkers() const { return num_workers; }
+
+    // With stream_fence, every worker but the launching thread calls
+    // psim_stream_fence() when it has run its gangs; the launching thread
+    // fences after the launch
+    void launch(uint64_t begin, uint64_t end, PsimSchedule schedule,
+                uint64_t chunk, bool stream_fence, GangFunc func, void* ctx) {
+        if (begin >= end) {
+            return;
+        }
+        chunk = std::max<uint64_t>(chunk, 1);
+
+        // Nested parallel regions and tiny grids run on the calling thread
+        if (inWorker() || num_workers == 1 || end - begin <= chunk) {
+            for (uint64_t gang = begin; gang < end; gang++) {
+                func(ctx, gang);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> launch_guard(launch_mutex);
+
+        uint64_t num_gangs = end - begin;
+        unsigned num_active = (unsigned)std::min<uint64_t>(
+            num_workers, ceilDiv(num_gangs, chunk));
+        for (unsigned w = 0; w < num_workers; w++) {
+            uint64_t b =
+                w < num_active ? begin + num_gangs * w / num_active : end;
+            uint64_t e =
+                w < num_active ? begin + num_gangs * (w + 1) / num_active : end;
+            std::lock_guard<std::mutex> guard(ranges[w].lock);
+            ranges[w].begin = b;
+            ranges[w].end = e;
+        }
+
+        job.func = func;
+        job.ctx = ctx;
+        job.schedule = schedule;
+        job.chunk = chunk;
+        job.num_active = num_active;
+        job.stream_fence = stream_fence;
+
+        {
+            std::lock_guard<std::mutex> guard(pool_mutex);
+            num_running = num_active - 1;
+            epoch++;
+        }
+        pool_cv.notify_all();
+
+        // The launching thread acts as worker 0
+        inWorker() = true;
+        runWorker(0);
+        inWorker() = false;
+
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        done_cv.wait(lock, [this] { return num_running == 0; });
+    }
+
+    ~PsimGridScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(pool_mutex);
+            stop = true;
+        }
+        pool_cv.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+  private:
+    struct alignas(64) Range {
+        std::mutex lock;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+    };
+
+    struct Job {
+        GangFunc func = nullptr;
+        void* ctx = nullptr;
+        PsimSchedule schedule = PSIM_SCHEDULE_STATIC;
+        uint64_t chunk = 1;
+        unsigned num_active = 0;
+        bool stream_fence = false;
+    };
+
+    unsigned num_workers;
+    std::vector<Range> ranges;
+    std::vector<std::thread> threads;
+    Job job;
+
+    std::mutex launch_mutex;
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    std::condition_variable done_cv;
+    uint64_t epoch = 0;
+    unsigned num_running = 0;
+    bool stop = false;
+
+    PsimGridScheduler() : num_workers(readNumWorkers()), ranges(num_workers) {
+        for (unsigned w = 1; w < num_workers; w++) {
+            threads.emplace_back([this, w] { workerLoop(w); });
+        }
+    }
+
+    static uint64_t ceilDiv(uint64_t a, uint64_t b) { return (a + b - 1) / b; }
+
+    static bool& inWorker() {
+        static thread_local bool in_worker = false;
+        return in_worker;
+    }
+
+    static unsigned readNumWorkers() {
+        for (const char* var : {"PSIM_NUM_THREADS", "OMP_NUM_THREADS"}) {
+            const char* s = std::getenv(var);
+            if (s && std::atoi(s) > 0) {
+                return (unsigned)std::atoi(s);
+            }
+        }
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    void workerLoop(unsigned w) {
+        inWorker() = true;
+        uint64_t seen_epoch = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                pool_cv.wait(lock, [&] { return stop || epoch != seen_epoch; });
+                if (stop) {
+                    return;
+                }
+                seen_epoch = epoch;
+            }
+            if (w >= job.num_active) {
+                continue;
+            }
+            runWorker(w);
+            if (job.stream_fence) {
+                psim_stream_fence();
+            }
+            {
+                std::lock_guard<std::mutex> guard(pool_mutex);
+                num_running--;
+            }
+            done_cv.notify_one();
+        }
+    }
+
+    // Claim the next gangs of the worker's own range
+    bool claim(unsigned w, uint64_t& b, uint64_t& e) {
+        Range& r = ranges[w];
+        std::lock_guard<std::mutex> guard(r.lock);
+        if (r.begin == r.end) {
+            return false;
+        }
+        uint64_t remaining = r.end - r.begin;
+        uint64_t n = remaining;
+        if (job.schedule == PSIM_SCHEDULE_DYNAMIC) {
+            n = std::min(remaining, job.chunk);
+        } else if (job.schedule == PSIM_SCHEDULE_GUIDED) {
+            n = std::min(remaining, std::max(ceilDiv(remaining, 2), job.chunk));
+        }
+        b = r.begin;
+        e = r.begin + n;
+        r.begin = e;
+        return true;
+    }
+
+    // Move the upper half of another worker's range into the worker's range
+    bool steal(unsigned w) {
+        for (unsigned i = 1; i < job.num_active; i++) {
+            Range& victim = ranges[(w + i) % job.num_active];
+            uint64_t b, e;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                uint64_t remaining = victim.end - victim.begin;
+                if (remaining <= job.chunk) {
+                    continue;
+                }
+                b = victim.end - remaining / 2;
+                e = victim.end;
+                victim.end = b;
+            }
+            Range& r = ranges[w];
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.begin = b;
+            r.end = e;
+            return true;
+        }
+        return false;
+    }
+
+    void runWorker(unsigned w) {
+        while (true) {
+            uint64_t b, e;
+            while (claim(w, b, e)) {
+                for (uint64_t gang = b; gang < e; gang++) {
+                    job.func(job.ctx, gang);
+                }
+            }
+            if (job.schedule == PSIM_SCHEDULE_STATIC || !steal(w)) {
+                return;
+            }
+        }
+    }
+};
+
+/* internal API used for code generation of "#psim parallel" regions */
+template <typename F>
+void __psim_grid_launch(uint64_t begin, uint64_t end, PsimSchedule schedule,
+                        uint64_t chunk, bool stream_fence, F func) {
+    PsimGridScheduler::instance().launch(
+        begin, end, schedule, chunk, stream_fence,
+        [](void* ctx, uint64_t gang) { (*static_cast<F*>(ctx))(gang); },
+        &func);
+}
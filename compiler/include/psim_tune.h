@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/*
+ * Gang size tuner used by "#psim gang_size(auto)" and
+ * "#psim gang_size(N1, N2, ...)" regions.
+ *
+ * The parsimony front-end emits one launch of the region per candidate gang
+ * size, and asks the PsimTuner of the call site which one to run. The first
+ * launches cycle through the candidates and are timed; once every candidate
+ * ran PSIM_TUNE_TRIALS times, the one with the lowest time per thread is
+ * pinned for the rest of the run.
+ *
+ * If the PSIM_TUNE_FILE environment variable is set, pinned choices are
+ * appended to that file as "<call site> <gang size>" lines and read back on
+ * the next run, which then skips the timed launches.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PSIM_TUNE_TRIALS 3
+
+class PsimTuner {
+  public:
+    PsimTuner(const char* site, std::vector<unsigned> gang_sizes)
+        : site(site),
+          gang_sizes(gang_sizes),
+          best_time(gang_sizes.size(), std::numeric_limits<double>::max()),
+          num_trials(gang_sizes.size(), 0) {
+        readProfile();
+    }
+
+    // Index of the gang size to run for the next launch
+    unsigned select() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (pinned >= 0) {
+            return pinned;
+        }
+        unsigned variant = next;
+        next = (next + 1) % gang_sizes.size();
+        return variant;
+    }
+
+    static uint64_t start() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void record(unsigned variant, uint64_t start_ns, uint64_t grid_size) {
+        uint64_t elapsed = start() - start_ns;
+        std::lock_guard<std::mutex> guard(mutex);
+        if (pinned >= 0 || grid_size == 0) {
+            return;
+        }
+        best_time[variant] =
+            std::min(best_time[variant], (double)elapsed / grid_size);
+        num_trials[variant]++;
+
+        unsigned best = 0;
+        for (unsigned i = 0; i < gang_sizes.size(); i++) {
+            if (num_trials[i] < PSIM_TUNE_TRIALS) {
+                return;
+            }
+            if (best_time[i] < best_time[best]) {
+                best = i;
+            }
+        }
+        pinned = best;
+        writeProfile();
+    }
+
+  private:
+    const char* site;
+    std::vector<unsigned> gang_sizes;
+    std::vector<double> best_time;
+    std::vector<unsigned> num_trials;
+    std::mutex mutex;
+    unsigned next = 0;
+    int pinned = -1;
+
+    // The last line of the profile for this site wins. The gang size is the
+    // last field of a line, so the call site may contain spaces.
+    void readProfile() {
+        const char* path = std::getenv("PSIM_TUNE_FILE");
+        if (!path) {
+            return;
+        }
+        std::ifstream f(path);
+        std::string line;
+        while (std::getline(f, line)) {
+            size_t pos = line.rfind(' ');
+            if (pos == std::string::npos || line.compare(0, pos, site) != 0) {
+                continue;
+            }
+            char* end;
+            unsigned long gang_size =
+                std::strtoul(line.c_str() + pos + 1, &end, 10);
+            if (end == line.c_str() + pos + 1 || *end != '\0') {
+                continue;
+            }
+            for (unsigned i = 0; i < gang_sizes.size(); i++) {
+                if (gang_sizes[i] == gang_size) {
+                    pinned = i;
+                }
+            }
+        }
+    }
+
+    void writeProfile() {
+        const char* path = std::getenv("PSIM_TUNE_FILE");
+        FILE* f = path ? std::fopen(path, "a") : nullptr;
+        if (!f) {
+            return;
+        }
+        std::fprintf(f, "%s %u\n", site, gang_sizes[pinned]);
+        std::fclose(f);
+    }
+};
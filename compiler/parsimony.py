@@ -65,15 +65,25 @@ def brace_depth(s, lbrace, rbrace, depth = 0):
 
 ###########################################################################################################
 
-def genParReg(name, body, has_cond, linemarker):
+def genParReg(name, body, has_cond, linemarker, nontemporal, prefetch, math):
     s  = "int __attribute__((annotate(\"fence\"))) __psim_fence_attr;\n"
     s += "(void) __psim_fence_attr;\n"
     s += "__psim_set_gang_size((unsigned) __psim_gang_size);\n"
     s += "__psim_set_gang_num(__psim_i/__psim_gang_size);\n"
     s += "__psim_set_grid_size(__psim_grid_size);\n"
     s += "__psim_set_grid_sub_name(\"" + name + "\");\n"
+    if prefetch:
+        s += "__psim_set_prefetch_distance((unsigned) " + prefetch + ");\n"
+    if math:
+        s += "__psim_set_math_accuracy((unsigned) " + math + ");\n"
+    # the region sees the pointers of "nontemporal(...)" through
+    # psim_nontemporal()
+    for i, ptr in enumerate(nontemporal):
+        s += "auto __psim_nontemporal_" + str(i) + " = " + ptr + ";\n"
     s += "#pragma omp parallel\n"
     s += "{\n"
+    for i, ptr in enumerate(nontemporal):
+        s += "    auto " + ptr + " = psim_nontemporal(__psim_nontemporal_" + str(i) + ");\n"
     if has_cond:
         s += "    if(__psim_i + psim_get_lane_num() < __psim_grid_size)\n"
     s += linemarker
@@ -83,13 +93,55 @@ def genParReg(name, body, has_cond, linemarker):
 
 ###########################################################################################################
 
-launch_gangs_head_body_tail_template = """
+launch_loop_template = """
     {
         uint64_t __psim_i = 0;
         const uint64_t __psim_grid_size = $GRID_SIZE$;
         const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
         for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+$GANG$
+        }
+$FENCE$
+    }
+"""
+
+# "parallel" regions: the first and last gangs are peeled and run on the
+# calling thread, all gangs in between are body gangs and are distributed by
+# the grid scheduler runtime (see include/psim_grid.h)
+launch_parallel_template = """
+    {
+        uint64_t __psim_i = 0;
+        const uint64_t __psim_grid_size = $GRID_SIZE$;
+        const uint64_t __psim_gang_size = $GANG_SIZE$;
+        const uint64_t __psim_num_gangs = (__psim_grid_size + $GANG_SIZE$ - 1) / $GANG_SIZE$;
+        for(uint64_t __psim_edge = 0; __psim_edge < 2 && __psim_edge < __psim_num_gangs; __psim_edge++) {
+            __psim_i = __psim_edge == 0 ? 0 : (__psim_num_gangs - 1) * $GANG_SIZE$;
+$GANG$
+        }
+        if (__psim_num_gangs > 2) {
+            __psim_grid_launch(1, __psim_num_gangs - 1, $SCHEDULE$, $CHUNK$, $STREAM_FENCE$, [&](uint64_t __psim_gang) {
+                uint64_t __psim_i = __psim_gang * $GANG_SIZE$;
+                $BODY$
+            });
+        }
+$FENCE$
+    }
+"""
+
+# regions with several candidate gang sizes: one launch per gang size, the
+# PsimTuner of the call site picks which one runs (see include/psim_tune.h)
+launch_tuned_template = """
+    {
+        static PsimTuner __psim_tuner("$SITE$", {$GANG_SIZES$});
+        const unsigned __psim_variant = __psim_tuner.select();
+        const uint64_t __psim_tune_grid_size = $GRID_SIZE$;
+        const uint64_t __psim_tune_start = PsimTuner::start();
+$VARIANTS$
+        __psim_tuner.record(__psim_variant, __psim_tune_start, __psim_tune_grid_size);
+    }
+"""
+
+gang_gangs_head_body_tail_template = """
             if ( __psim_i  == 0 && $GANG_SIZE$ == __psim_grid_size) {
                 $HEAD_TAIL$
             } else if (__psim_i  == 0) {
@@ -99,62 +151,30 @@ launch_gangs_head_body_tail_template = """
             } else if (__psim_i + $GANG_SIZE$ == __psim_grid_size) {
                 $TAIL$
             }
-        }
-    }
 """
 
-launch_gangs_body_tail_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_gangs_body_tail_template = """
             if (__psim_i + $GANG_SIZE$ == __psim_grid_size) {
                 $TAIL$
             } else {
                 $BODY$
             }
-        }
-    }
 """
 
-launch_gangs_head_body_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_gangs_head_body_template = """
             if (__psim_i  == 0) {
                 $HEAD$
             } else {
                 $BODY$
             }
-        }
-    }
 """
 
-launch_gangs_body_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_gangs_body_template = """
             $BODY$
-        }
-    }
 """
 ###########################################################################################################
 
-launch_threads_head_body_tail_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_threads_head_body_tail_template = """
             if ( __psim_i  == 0 && $GANG_SIZE$ == __psim_grid_size) {
                 $HEAD_TAIL$
             } else if (__psim_i  == 0 && $GANG_SIZE$ > __psim_grid_size) {
@@ -168,17 +188,9 @@ launch_threads_head_body_tail_template = """
             } else {
                 $TAIL_COND$
             }
-        }
-    }
 """
 
-launch_threads_body_tail_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_threads_body_tail_template = """
             if (__psim_i  == 0 && $GANG_SIZE$ > __psim_grid_size) {
                 $TAIL_COND$
             } else if (__psim_i + $GANG_SIZE$ < __psim_grid_size) {
@@ -186,17 +198,9 @@ launch_threads_body_tail_template = """
             } else if (__psim_i + $GANG_SIZE$ == __psim_grid_size) {
                 $TAIL$
             }
-        }
-    }
 """
 
-launch_threads_head_body_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_threads_head_body_template = """
             if (__psim_i  == 0 && $GANG_SIZE$ > __psim_grid_size) {
                 $HEAD_COND$
             } else if (__psim_i  == 0) {
@@ -206,31 +210,38 @@ launch_threads_head_body_template = """
             } else {
                 $BODY_COND$
             }
-        }
-    }
 """
 
-launch_threads_body_template = """
-    {
-        uint64_t __psim_i = 0;
-        const uint64_t __psim_grid_size = $GRID_SIZE$;
-        const uint64_t __psim_gang_size = $GANG_SIZE$;
-        $PARALLEL$
-        for(__psim_i = 0; __psim_i < __psim_grid_size; __psim_i += $GANG_SIZE$) {
+gang_threads_body_template = """
             if (__psim_i + $GANG_SIZE$ <= __psim_grid_size) {
                 $BODY$
             } else {
                 $BODY_COND$
             }
-        }
-    }
 """
 ###########################################################################################################
 # true or false if the have some value
 known_directives = { "gang_size": True,
                      "num_spmd_threads": True,
                      "num_spmd_gangs": True,
-                     "parallel": False}
+                     "parallel": False,
+                     "schedule": True,
+                     "nontemporal": True,
+                     "prefetch": True,
+                     "math": True}
+
+known_schedules = { "static": "PSIM_SCHEDULE_STATIC",
+                    "dynamic": "PSIM_SCHEDULE_DYNAMIC",
+                    "guided": "PSIM_SCHEDULE_GUIDED"}
+
+# accuracy of the vector math functions, the values are MathAccuracy in psv
+# (see src/utils.h)
+known_math_accuracies = { "precise": "0",
+                          "fast": "1",
+                          "approx": "2"}
+
+# candidate gang sizes of "gang_size(auto)"
+auto_gang_sizes = ["16", "32", "64"]
 
 def process_psim_annotations(infilename, outfilename, args):
     if args.verbose:
@@ -293,9 +304,53 @@ def process_omp_psim_pragmas(infilename, outfilename, orig_filename, args):
                 if not gang_size:
                     sys.stderr.write("parsimony: error: \"#psim\" must specify gang_size!\n\n")
                     sys.exit(1)
-                parallel = ""
-                if "parallel" in directives:
-                    parallel = "#pragma omp parallel for"
+                parallel = "parallel" in directives
+                schedule = directives.get("schedule")
+                if schedule and not parallel:
+                    sys.stderr.write("parsimony: error: \"#psim\" schedule requires parallel\n\n")
+                    sys.exit(1)
+                schedule_kind = "static"
+                schedule_chunk = "1"
+                if schedule:
+                    schedule_args = [a.strip() for a in schedule[1:-1].split(",", 1)]
+                    schedule_kind = schedule_args[0]
+                    if len(schedule_args) > 1:
+                        schedule_chunk = schedule_args[1]
+                    if schedule_kind not in known_schedules:
+                        sys.stderr.write("parsimony: error: \"#psim\" schedule: " + schedule_kind + " unknown!\n\n")
+                        sys.exit(1)
+
+                # distance in gangs of the prefetches of the region, see
+                # ShapesStep::calculatePrefetchOffsets in psv
+                prefetch = directives.get("prefetch")
+
+                math = None
+                if directives.get("math"):
+                    math_accuracy = directives.get("math")[1:-1].strip()
+                    if math_accuracy not in known_math_accuracies:
+                        sys.stderr.write("parsimony: error: \"#psim\" math: " + math_accuracy + " unknown!\n\n")
+                        sys.exit(1)
+                    math = known_math_accuracies[math_accuracy]
+
+                nontemporal = []
+                if directives.get("nontemporal"):
+                    nontemporal = [p.strip() for p in directives.get("nontemporal")[1:-1].split(",")]
+                    for ptr in nontemporal:
+                        if not re.fullmatch(r"[A-Za-z_]\w*", ptr):
+                            sys.stderr.write("parsimony: error: \"#psim\" nontemporal: " + ptr + " is not a variable name\n\n")
+                            sys.exit(1)
+
+                # "gang_size(auto)" and "gang_size(N1, N2, ...)" emit a
+                # launch per gang size
+                gang_sizes = [gang_size]
+                gang_size_args = gang_size[1:-1].strip()
+                if gang_size_args == "auto":
+                    gang_sizes = ["(" + g + ")" for g in auto_gang_sizes]
+                elif "," in gang_size_args:
+                    gang_sizes = ["(" + g.strip() + ")" for g in gang_size_args.split(",")]
+                if len(gang_sizes) > 1 and num_spmd_gangs:
+                    sys.stderr.write("parsimony: error: \"#psim\" several gang sizes require num_spmd_threads\n\n")
+                    sys.exit(1)
 
                 if num_spmd_gangs and num_spmd_threads:
                     sys.stderr.write("parsimony: error: \"#psim\" cant specify num_spmd_gangs and num_spmd_threads at the same time\n\n")
@@ -330,10 +385,15 @@ def process_omp_psim_pragmas(infilename, outfilename, orig_filename, args):
                     sys.stderr.write("Found #psim\n")
                     sys.stderr.write("num_spmd_threads: " + str(num_spmd_threads) + "\n")
                     sys.stderr.write("num_spmd_gangs: " + str(num_spmd_gangs) + "\n")
-                    sys.stderr.write("gang_size: " + str(gang_size) + "\n")
+                    sys.stderr.write("gang_size: " + ", ".join(gang_sizes) + "\n")
                     sys.stderr.write("uses psim_is_tail_gang(): " + str(uses_tail_gang) + "\n")
                     sys.stderr.write("uses psim_is_head_gang(): " + str(uses_head_gang) + "\n")
-                    sys.stderr.write("parallel: " + parallel + "\n")
+                    sys.stderr.write("parallel: " + str(parallel) + "\n")
+                    sys.stderr.write("nontemporal: " + ", ".join(nontemporal) + "\n")
+                    sys.stderr.write("prefetch: " + str(prefetch) + "\n")
+                    sys.stderr.write("math: " + str(math) + "\n")
+                    if parallel:
+                        sys.stderr.write("schedule: " + schedule_kind + ", " + schedule_chunk + "\n")
 
                 body_gang = body.replace("psim_is_tail_gang()", "false").replace("psim_is_head_gang()", "false")
                 tail_gang = body.replace("psim_is_tail_gang()", "true").replace("psim_is_head_gang()", "false")
@@ -341,44 +401,77 @@ def process_omp_psim_pragmas(infilename, outfilename, orig_filename, args):
                 head_tail_gang = body.replace("psim_is_tail_gang()", "true").replace("psim_is_head_gang()", "true")
 
 
-                if num_spmd_gangs:
-                    if uses_tail_gang and uses_head_gang:
-                        launch = launch_gangs_head_body_tail_template
-                    elif not uses_tail_gang and uses_head_gang:
-                        launch = launch_gangs_head_body_template
-                    elif uses_tail_gang and not uses_head_gang:
-                        launch = launch_gangs_body_tail_template
-                    else:
-                        launch = launch_gangs_body_template
-                    grid_size = "((" + num_spmd_gangs + ") * (" + gang_size + "))"
-                else:
-                    assert num_spmd_threads
-                    if uses_tail_gang and uses_head_gang:
-                        launch = launch_threads_head_body_tail_template
-                    elif not uses_tail_gang and uses_head_gang:
-                        launch = launch_threads_head_body_template
-                    elif uses_tail_gang and not uses_head_gang:
-                        launch = launch_threads_body_tail_template
-                    else:
-                        launch = launch_threads_body_template
-                    grid_size = num_spmd_threads
-
-
                 linemarker = "# " +  str(body_line_start) + " \"" + orig_filename + "\"\n"
 
-                launch = launch.replace("$PARALLEL$", parallel)
-                launch = launch.replace("$GANG_SIZE$", gang_size)
-                launch = launch.replace("$GRID_SIZE$", grid_size)
-
-                launch = launch.replace("$HEAD_TAIL$", genParReg("head_tail_gang", head_tail_gang, False, linemarker))
-                launch = launch.replace("$TAIL$", genParReg("tail_gang", tail_gang, False, linemarker))
-                launch = launch.replace("$HEAD$", genParReg("head_gang", head_gang, False, linemarker))
-                launch = launch.replace("$BODY$", genParReg("body_gang", body_gang, False, linemarker))
-
-                launch = launch.replace("$HEAD_TAIL_COND$", genParReg("head_tail_gang_bound_check", head_tail_gang, True, linemarker))
-                launch = launch.replace("$TAIL_COND$", genParReg("tail_gang_bound_check", tail_gang, True, linemarker))
-                launch = launch.replace("$HEAD_COND$", genParReg("head_gang_bound_check", head_gang, True, linemarker))
-                launch = launch.replace("$BODY_COND$", genParReg("body_gang_bound_check", body_gang, True, linemarker))
+                stream_fence = bool(nontemporal) or "psim_store_stream" in body
+
+                launches = []
+                for gang_size in gang_sizes:
+                    if num_spmd_gangs:
+                        if uses_tail_gang and uses_head_gang:
+                            gang = gang_gangs_head_body_tail_template
+                        elif not uses_tail_gang and uses_head_gang:
+                            gang = gang_gangs_head_body_template
+                        elif uses_tail_gang and not uses_head_gang:
+                            gang = gang_gangs_body_tail_template
+                        else:
+                            gang = gang_gangs_body_template
+                        grid_size = "((" + num_spmd_gangs + ") * (" + gang_size + "))"
+                    else:
+                        assert num_spmd_threads
+                        if uses_tail_gang and uses_head_gang:
+                            gang = gang_threads_head_body_tail_template
+                        elif not uses_tail_gang and uses_head_gang:
+                            gang = gang_threads_head_body_template
+                        elif uses_tail_gang and not uses_head_gang:
+                            gang = gang_threads_body_tail_template
+                        else:
+                            gang = gang_threads_body_template
+                        grid_size = num_spmd_threads
+
+
+                    if parallel:
+                        launch = launch_parallel_template
+                        launch = launch.replace("$SCHEDULE$", known_schedules[schedule_kind])
+                        launch = launch.replace("$CHUNK$", "(" + schedule_chunk + ")")
+                    else:
+                        launch = launch_loop_template
+                    launch = launch.replace("$GANG$", gang)
+                    # order the non-temporal stores before the code that
+                    # follows the region: once on the launching thread, and
+                    # once by each grid worker when it has run its gangs
+                    launch = launch.replace("$FENCE$", "        psim_stream_fence();" if stream_fence else "")
+                    launch = launch.replace("$STREAM_FENCE$", "true" if stream_fence else "false")
+                    launch = launch.replace("$GANG_SIZE$", gang_size)
+                    launch = launch.replace("$GRID_SIZE$", grid_size)
+
+                    launch = launch.replace("$HEAD_TAIL$", genParReg("head_tail_gang", head_tail_gang, False, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$TAIL$", genParReg("tail_gang", tail_gang, False, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$HEAD$", genParReg("head_gang", head_gang, False, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$BODY$", genParReg("body_gang", body_gang, False, linemarker, nontemporal, prefetch, math))
+
+                    launch = launch.replace("$HEAD_TAIL_COND$", genParReg("head_tail_gang_bound_check", head_tail_gang, True, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$TAIL_COND$", genParReg("tail_gang_bound_check", tail_gang, True, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$HEAD_COND$", genParReg("head_gang_bound_check", head_gang, True, linemarker, nontemporal, prefetch, math))
+                    launch = launch.replace("$BODY_COND$", genParReg("body_gang_bound_check", body_gang, True, linemarker, nontemporal, prefetch, math))
+
+                    launches.append(launch)
+
+                if len(launches) == 1:
+                    launch = launches[0]
+                else:
+                    variants = ""
+                    for i, variant in enumerate(launches):
+                        cond = "if" if i == 0 else "else if"
+                        variants += "        " + cond + " (__psim_variant == " + str(i) + ")" + variant
+                    launch = launch_tuned_template
+                    # the call site is a C string literal
+                    site = orig_filename + ":" + str(body_line_start)
+                    site = site.replace("\\", "\\\\").replace("\"", "\\\"")
+                    launch = launch.replace("$SITE$", site)
+                    launch = launch.replace("$GANG_SIZES$", ", ".join(gang_sizes))
+                    launch = launch.replace("$GRID_SIZE$", grid_size)
+                    launch = launch.replace("$VARIANTS$", variants)
 
                 launch += "# " +  str(line_count) + " \"" + orig_filename + "\"\n"
                 outcode += launch
@@ -435,9 +528,15 @@ def run_compiler_steps(infilename, args, unknownargs):
 
         #step 4: middle-end -- call psv to vectorize pre-bitcode into post-bitcode
         post_vec_bitcode_file = tmp_filename_base + ".post_vec.ll"
+        psv_cache_args = ""
+        if args.solver_cache:
+            psv_cache_args = " --solver-cache " + d + os.sep + "psv.solver_cache"
+        psv_isa_args = ""
+        if args.isas:
+            psv_isa_args = " --isa " + args.isas
         run(args, script_path + "/psv -i " + \
                 pre_vec_bitcode_file + " -o " + \
-                post_vec_bitcode_file + " " + args.extra_psv_args)
+                post_vec_bitcode_file + psv_cache_args + psv_isa_args + " " + args.extra_psv_args)
 
         # step 5: back-end -- compile to object or binary
         if args.compile:
@@ -465,6 +564,8 @@ def main():
     # script options they all start with --X
     argparser.add_argument("--Xpsv", dest="extra_psv_args", type=str, default="", help="Extra argument passed to psv.")
     argparser.add_argument("--Xtmp", dest="tmpdir", type=str, default="tmp", help="Folder for temporary files.")
+    argparser.add_argument("--Xcache", dest="solver_cache", action="store_true", help="Persist psv's shape solver query cache in the --Xtmp folder.")
+    argparser.add_argument("--Xisa", dest="isas", type=str, default="", help="Comma separated list of ISAs (sse, avx, avx2, avx512) each #psim region is compiled for; the widest one supported by the CPU is selected at runtime.")
     argparser.add_argument("--Xv",   dest="verbose", action="store_true", help="Verbose flag for the parsimony script.")
     argparser.add_argument("-h",     dest="help", action="store_true", help="Print help message.")
 
@@ -505,10 +606,10 @@ def main():
     # link step
     if not args.compile:
         if not sleef_path:
-            run(args, llvm_path + "/bin/clang++ -fopenmp " + " ".join(unknownargs) + \
+            run(args, llvm_path + "/bin/clang++ -fopenmp -pthread " + " ".join(unknownargs) + \
                 " -Wl,-rpath," + llvm_path + "/lib/ " +  " ".join(objs)  + " -o " + args.outputfile)
         else:
-            run(args, llvm_path + "/bin/clang++ -fopenmp " + " ".join(unknownargs) + \
+            run(args, llvm_path + "/bin/clang++ -fopenmp -pthread " + " ".join(unknownargs) + \
                 " -Wl,-rpath," + sleef_path + "/lib64/ " +  " -Wl,-rpath," + llvm_path + \
                 "/lib/ " +  " ".join(objs) + " -L" + sleef_path + "/lib64 -lsleef" + " -o " + args.outputfile)
 
@@ -68,11 +68,17 @@ class ArgumentReader {
                               << "\n";
                     exit(1);
                 }
-                oParam = get<T>(pos + 1);
+                oParam = get<T>(args[pos + 1].value);
                 args[pos].checked = true;
                 args[pos + 1].checked = true;
                 return true;
             }
+            // "name=value"
+            if (args[pos].value.compare(0, name.size() + 1, name + "=") == 0) {
+                oParam = get<T>(args[pos].value.substr(name.size() + 1));
+                args[pos].checked = true;
+                return true;
+            }
         }
         return false;
     }
@@ -123,8 +129,8 @@ class ArgumentReader {
     }
 
     template <class T>
-    T get(int idx) {
-        std::istringstream ss(args[idx].value);
+    T get(const std::string& value) {
+        std::istringstream ss(value);
         T result;
         ss >> result;
         return result;
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#include "boscc.h"
+
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <unordered_set>
+
+#include "utils.h"
+
+using namespace llvm;
+
+namespace ps {
+
+unsigned boscc_verbosity_level;
+[[maybe_unused]] static unsigned& verbosity_level = boscc_verbosity_level;
+
+BosccStep::BosccStep(VectorizedFunctionInfo& vf_info) : vf_info(vf_info) {}
+
+void BosccStep::run() {
+    if (global_opts.boscc_threshold == 0) {
+        return;
+    }
+
+    // Blocks entered through a branch on any(mask), i.e., the 'then' blocks
+    // of varying conditions. Loop headers have two predecessors.
+    std::vector<BasicBlock*> candidates;
+    for (BasicBlock& P : *vf_info.VF) {
+        BranchInst* br = dyn_cast<BranchInst>(P.getTerminator());
+        if (!br || !br->isConditional()) {
+            continue;
+        }
+        IntrinsicInst* any = dyn_cast<IntrinsicInst>(br->getCondition());
+        if (!any || any->getIntrinsicID() != Intrinsic::vector_reduce_or) {
+            continue;
+        }
+        if (br->getSuccessor(0)->getSinglePredecessor() != &P) {
+            continue;
+        }
+        candidates.push_back(br->getSuccessor(0));
+    }
+
+    // Outer regions come first; the inner regions of their original copy
+    // are still candidates afterwards
+    for (BasicBlock* BB : candidates) {
+        cloneRegion(BB);
+    }
+}
+
+void BosccStep::cloneRegion(BasicBlock* BB) {
+    BasicBlock* P = BB->getSinglePredecessor();
+    BranchInst* br = cast<BranchInst>(P->getTerminator());
+    BasicBlock* exit = br->getSuccessor(1);
+    Value* mask = cast<IntrinsicInst>(br->getCondition())->getArgOperand(0);
+
+    // The region is the set of blocks dominated by BB
+    DominatorTree DT(*vf_info.VF);
+    SmallVector<BasicBlock*> region;
+    DT.getDescendants(BB, region);
+    std::unordered_set<BasicBlock*> in_region(region.begin(), region.end());
+
+    // The region must be single-entry single-exit, and its values may only
+    // be used by the PHIs of the exit block
+    unsigned size = 0;
+    for (BasicBlock* R : region) {
+        if (isa<ReturnInst>(R->getTerminator())) {
+            return;
+        }
+        for (BasicBlock* succ : successors(R)) {
+            if (!in_region.count(succ) && succ != exit) {
+                return;
+            }
+        }
+        for (Instruction& I : *R) {
+            if (!isa<PHINode>(I) && !I.isDebugOrPseudoInst()) {
+                size++;
+            }
+            for (Use& U : I.uses()) {
+                Instruction* user = cast<Instruction>(U.getUser());
+                if (in_region.count(user->getParent())) {
+                    continue;
+                }
+                PHINode* phi = dyn_cast<PHINode>(user);
+                if (!phi || phi->getParent() != exit ||
+                    !in_region.count(phi->getIncomingBlock(U))) {
+                    PRINT_MID("Not cloning region " << BB->getName()
+                                                    << ": " << I
+                                                    << " is live out");
+                    return;
+                }
+            }
+        }
+    }
+    if (size < global_opts.boscc_threshold) {
+        PRINT_HIGH("Not cloning region " << BB->getName() << ": " << size
+                                         << " instructions");
+        return;
+    }
+    PRINT_LOW("Cloning region " << BB->getName() << " (" << region.size()
+                                << " blocks, " << size
+                                << " instructions) for full masks");
+
+    // Clone the region with the mask replaced by the constant true
+    ValueToValueMapTy value_map;
+    value_map[mask] = Constant::getAllOnesValue(mask->getType());
+    SmallVector<BasicBlock*> clones;
+    for (BasicBlock* R : region) {
+        BasicBlock* C = CloneBasicBlock(R, value_map, ".full", vf_info.VF);
+        value_map[R] = C;
+        clones.push_back(C);
+    }
+    remapInstructionsInBlocks(clones, value_map);
+
+    // The clone reaches the same exit block
+    for (PHINode& phi : exit->phis()) {
+        for (unsigned i = 0, n = phi.getNumIncomingValues(); i < n; i++) {
+            BasicBlock* incoming = phi.getIncomingBlock(i);
+            if (!in_region.count(incoming)) {
+                continue;
+            }
+            Value* v = phi.getIncomingValue(i);
+            auto it = value_map.find(v);
+            phi.addIncoming(it != value_map.end() ? (Value*)it->second : v,
+                            cast<BasicBlock>(value_map[incoming]));
+        }
+    }
+
+    // P: br any(mask), BB_all, exit
+    // BB_all: br all(mask), BB.full, BB
+    BasicBlock* check = BasicBlock::Create(
+        vf_info.ctx, BB->getName() + "_all", vf_info.VF, BB);
+    BasicBlock* clone = cast<BasicBlock>(value_map[BB]);
+    IRBuilder<> builder(check);
+    Value* all = builder.CreateAndReduce(mask);
+    all->setName(BB->getName() + "_all");
+    builder.CreateCondBr(all, clone, BB);
+    br->setSuccessor(0, check);
+    BB->replacePhiUsesWith(P, check);
+    clone->replacePhiUsesWith(P, check);
+}
+
+}  // namespace ps
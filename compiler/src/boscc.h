@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#pragma once
+
+#include <vector>
+
+#include <llvm/IR/Function.h>
+
+#include "vectorize.h"
+
+namespace ps {
+
+extern unsigned boscc_verbosity_level;
+
+/* Branch on superword condition code.
+ *
+ * After the transform step, a block guarded by a varying condition is
+ * entered through a branch on any(mask), so the region is already skipped
+ * when no lane is active. When all the lanes are active, the region still
+ * runs with masked memory operations and selects. For the regions with at
+ * least global_opts.boscc_threshold instructions, this step adds a branch on
+ * all(mask) to a clone of the region in which the mask is the constant true,
+ * so that the masks fold away.
+ */
+class BosccStep {
+  public:
+    BosccStep(VectorizedFunctionInfo& vf_info);
+    void run();
+
+  private:
+    VectorizedFunctionInfo& vf_info;
+
+    void cloneRegion(llvm::BasicBlock* BB);
+};
+
+}  // namespace ps
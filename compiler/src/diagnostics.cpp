@@ -57,6 +57,8 @@ void printDiagnostics(VectorizedFunctionInfo* vf_info) {
         !vf_info->diagnostics.gathers.empty() ||
         !vf_info->diagnostics.scatters.empty() ||
         !vf_info->diagnostics.scalarized_called_functions.empty() ||
+        !vf_info->diagnostics.cloned_called_functions.empty() ||
+        !vf_info->diagnostics.vmath_functions.empty() ||
         !vf_info->diagnostics.function_pointer_calls.empty() ||
         !vf_info->diagnostics.unoptimized_allocas.empty();
     if (!hasDiagnostics || verbosity_level == 0) {
@@ -113,6 +115,11 @@ void printDiagnostics(VectorizedFunctionInfo* vf_info) {
     }
     printSet(vf_info->diagnostics.scalarized_called_functions,
              "Emitted scalarized calls to", "functions", "  ", true);
+    printSet(vf_info->diagnostics.cloned_called_functions,
+             "Emitted calls to", "vectorized clones of functions");
+    printSet(vf_info->diagnostics.vmath_functions, "Emitted vector math for",
+             std::string("functions with math(") +
+                 getMathAccuracyName(vf_info->getMathAccuracy()) + ")");
     printVector(vf_info->diagnostics.function_pointer_calls,
                 "Emitted scalarized calls to", "function pointers");
     printVector(vf_info->diagnostics.unoptimized_allocas, "Emitted",
@@ -10,11 +10,13 @@
 
 
 #include "function.h"
+#include "boscc.h"
 #include "inst_order.h"
 #include "live_out.h"
 #include "mask.h"
 #include "prints.h"
 #include "shapes.h"
+#include "time_report.h"
 #include "transform.h"
 
 using namespace llvm;
@@ -27,16 +29,27 @@ unsigned function_verbosity_level;
 FunctionVectorizer::FunctionVectorizer(VectorizedFunctionInfo& vf_info)
     : vf_info(vf_info) {}
 
-void FunctionVectorizer::vectorize() {
-    vf_info.getAnalyses();
-
-    MasksStep(vf_info).calculate();
-    LiveOutPHIsStep(vf_info).calculate();
-    InstructionOrderStep(vf_info).calculate();
-    ShapesStep(vf_info).calculate();
-    TransformStep(vf_info).transform();
+template <typename F>
+static void timeStep(VectorizedFunctionInfo& vf_info, const char* step, F f) {
+    TimeReportScope scope(vf_info.VF->getName().str(), step);
+    f();
+}
 
-    vf_info.verifyTransformedFunction();
+void FunctionVectorizer::vectorize() {
+    timeStep(vf_info, "getAnalyses", [&] { vf_info.getAnalyses(); });
+
+    timeStep(vf_info, "MasksStep", [&] { MasksStep(vf_info).calculate(); });
+    timeStep(vf_info, "LiveOutPHIsStep",
+             [&] { LiveOutPHIsStep(vf_info).calculate(); });
+    timeStep(vf_info, "InstructionOrderStep",
+             [&] { InstructionOrderStep(vf_info).calculate(); });
+    timeStep(vf_info, "ShapesStep", [&] { ShapesStep(vf_info).calculate(); });
+    timeStep(vf_info, "TransformStep",
+             [&] { TransformStep(vf_info).transform(); });
+    timeStep(vf_info, "BosccStep", [&] { BosccStep(vf_info).run(); });
+
+    timeStep(vf_info, "verifyTransformedFunction",
+             [&] { vf_info.verifyTransformedFunction(); });
 
     PRINT_LOW("Done vectorizing " << vf_info.VF->getName() << "\n");
     PRINT_MID(*vf_info.VF << "\n");
@@ -10,6 +10,7 @@
 
 
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <unordered_set>
@@ -25,6 +26,7 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include "argument_reader.h"
+#include "boscc.h"
 #include "diagnostics.h"
 #include "function.h"
 #include "inst_order.h"
@@ -33,6 +35,8 @@
 #include "module.h"
 #include "prints.h"
 #include "shapes.h"
+#include "solver_cache.h"
+#include "time_report.h"
 #include "transform.h"
 #include "utils.h"
 
@@ -47,6 +51,7 @@ Module* createModuleFromFile(const std::string& fileName,
 }
 
 int main(int argc, char** argv) {
+    auto start_time = std::chrono::steady_clock::now();
     ArgumentReader reader(argc, argv);
 
     std::string inFile, outFile;
@@ -67,9 +72,68 @@ int main(int argc, char** argv) {
         reader.hasOption("-Werror", "Treat the warnings as errors");
     global_opts.ignore_warn_set = reader.hasOption(
         "-Iwarnset", "Ignore set of warning on/off inside the application");
+    global_opts.num_jobs = 1;
+    reader.readOption<unsigned>(
+        "-j", global_opts.num_jobs,
+        "Number of functions vectorized concurrently (0=number of hardware "
+        "threads)");
+    time_report.enabled = reader.hasOption(
+        "--time-report",
+        "Print the compile time of each step, per function and in total");
+    if (reader.hasOption("--time-report=json",
+                         "Print the time report in json format")) {
+        time_report.enabled = true;
+        time_report.json = true;
+    }
+    global_opts.versioning = !reader.hasOption(
+        "--no-versioning",
+        "Don't version functions with symbolic strides (see README)");
+    global_opts.clone_called_functions = !reader.hasOption(
+        "--no-clone-calls",
+        "Call the functions without a matching vector variant once per lane "
+        "instead of vectorizing a clone of them (see README)");
+    global_opts.boscc_threshold = 32;
+    reader.readOption<unsigned>(
+        "--boscc-threshold", global_opts.boscc_threshold,
+        "Minimum number of instructions of a divergent region to clone it for "
+        "the case where all lanes are active (0=disabled)");
+    global_opts.prefetch_distance = 0;
+    reader.readOption<unsigned>(
+        "--prefetch-distance", global_opts.prefetch_distance,
+        "Distance in gangs of the prefetches emitted for the loads of the psim "
+        "entry points whose address advances by a constant with the gang "
+        "number (0=disabled), unless set by the region");
+    global_opts.math_accuracy = MATH_PRECISE;
+    std::string math_accuracy;
+    if (reader.readOption<std::string>(
+            "-fmath", math_accuracy,
+            "Accuracy of the vector math functions, unless set by the region: "
+            "precise (1-ULP, default), fast (3.5-ULP) or approx (in-tree "
+            "approximations, for finite arguments and below 5e-5 relative "
+            "error)") &&
+        !parseMathAccuracy(math_accuracy, global_opts.math_accuracy)) {
+        FATAL("Invalid -fmath accuracy " << math_accuracy);
+    }
+    std::string isas;
+    if (reader.readOption<std::string>(
+            "--isa", isas,
+            "Comma separated list of ISAs (sse, avx, avx2, avx512) the psim "
+            "entry points are vectorized for, selected at runtime from the "
+            "CPU features") &&
+        !parseTargetIsas(isas, global_opts.isas)) {
+        std::cerr << "Invalid --isa list " << isas << "\n";
+        return 1;
+    }
+    std::string solver_cache_file;
+    bool hasSolverCacheFile = reader.readOption<std::string>(
+        "--solver-cache", solver_cache_file,
+        "File used to persist the shape solver query cache across runs");
+    bool print_solver_cache_stats = reader.hasOption(
+        "--solver-cache-stats", "Print the shape solver query cache hit rate");
 
     unsigned verbosity_level = 0;
     reader.readOption<unsigned>("-v", verbosity_level, "Global verbosity flag");
+    boscc_verbosity_level = verbosity_level;
     broadcast_verbosity_level = verbosity_level;
     diagnostics_verbosity_level = verbosity_level;
     function_verbosity_level = verbosity_level;
@@ -80,11 +144,13 @@ int main(int argc, char** argv) {
     prints_verbosity_level = verbosity_level;
     resolver_verbosity_level = verbosity_level;
     shapes_verbosity_level = verbosity_level;
+    solver_cache_verbosity_level = verbosity_level;
     transform_verbosity_level = verbosity_level;
     vectorize_verbosity_level = verbosity_level;
     value_cache_verbosity_level = verbosity_level;
     vfabi_verbosity_level = verbosity_level;
 
+    reader.readOption<unsigned>("--vboscc", boscc_verbosity_level);
     reader.readOption<unsigned>("--vbroadcast", broadcast_verbosity_level);
     reader.readOption<unsigned>("--vdiagnostics", diagnostics_verbosity_level);
     reader.readOption<unsigned>("--vfunction", function_verbosity_level);
@@ -95,6 +161,8 @@ int main(int argc, char** argv) {
     reader.readOption<unsigned>("--vprints", prints_verbosity_level);
     reader.readOption<unsigned>("--vresolver", resolver_verbosity_level);
     reader.readOption<unsigned>("--vshapes", shapes_verbosity_level);
+    reader.readOption<unsigned>("--vsolver_cache",
+                                solver_cache_verbosity_level);
     reader.readOption<unsigned>("--vtransform", transform_verbosity_level);
     reader.readOption<unsigned>("--vvectorize", vectorize_verbosity_level);
     reader.readOption<unsigned>("--vvalue_cache", value_cache_verbosity_level);
@@ -121,16 +189,24 @@ int main(int argc, char** argv) {
     LLVMContext context;
 
     // Load module
-    llvm::Module* mod = createModuleFromFile(inFile, context);
-    if (!mod) {
-        FATAL("Could not load module " << inFile << ". Aborting!\n");
-        return 1;
+    llvm::Module* mod;
+    {
+        TimeReportScope scope("<module>", "loadModule");
+        mod = createModuleFromFile(inFile, context);
+        if (!mod) {
+            FATAL("Could not load module " << inFile << ". Aborting!\n");
+            return 1;
+        }
+
+        bool broken = verifyModule(*mod, &errs());
+        if (broken) {
+            FATAL("Broken module!\n");
+            return 1;
+        }
     }
 
-    bool broken = verifyModule(*mod, &errs());
-    if (broken) {
-        FATAL("Broken module!\n");
-        return 1;
+    if (hasSolverCacheFile) {
+        solver_cache.load(solver_cache_file);
     }
 
     // Vectorize
@@ -144,11 +220,29 @@ int main(int argc, char** argv) {
 
     module_vectorizer.vectorizeFunctions();
 
-    if (hasOutFile) {
-        module_vectorizer.writeToFile(outFile);
-        PRINT_LOW("Final module written to \"" << outFile << "\"\n");
-    } else {
-        mod->print(llvm::outs(), nullptr, false, true);
+    if (hasSolverCacheFile) {
+        solver_cache.save(solver_cache_file);
+    }
+    if (print_solver_cache_stats || verbosity_level > 0) {
+        solver_cache.printStats();
+    }
+
+    {
+        TimeReportScope scope("<module>", "writeModule");
+        if (hasOutFile) {
+            module_vectorizer.writeToFile(outFile);
+            PRINT_LOW("Final module written to \"" << outFile << "\"\n");
+        } else {
+            mod->print(llvm::outs(), nullptr, false, true);
+        }
+    }
+
+    if (time_report.enabled) {
+        time_report.print(
+            llvm::errs(),
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_time)
+                .count());
     }
 
     return 0;
@@ -12,6 +12,7 @@
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/VectorUtils.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
@@ -32,15 +33,20 @@
 #include <llvm/Transforms/Utils/LoopSimplify.h>
 #include <llvm/Transforms/Utils/LowerInvoke.h>
 #include <llvm/Transforms/Utils/LowerSwitch.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
 #include <llvm/Transforms/Utils/UnifyFunctionExitNodes.h>
 #include <llvm/Transforms/Utils/UnifyLoopExits.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <unordered_set>
 
 #include "diagnostics.h"
 #include "function.h"
 #include "module.h"
 #include "rename_values.h"
+#include "time_report.h"
 #include "utils.h"
 
 using namespace llvm;
@@ -50,6 +56,68 @@ namespace ps {
 unsigned module_verbosity_level;
 [[maybe_unused]] static unsigned& verbosity_level = module_verbosity_level;
 
+/* ISAs the entry points can be vectorized for, from the narrowest to the
+ * widest. cpu_features are the bits of __cpu_model.__cpu_features[0] (the
+ * libgcc/compiler-rt structure behind __builtin_cpu_supports) which must all
+ * be set to run the code generated for target_features.
+ */
+struct TargetIsaInfo {
+    const char* name;
+    const char* letter;
+    const char* target_features;
+    const char* prefer_vector_width;
+    uint32_t cpu_features;
+};
+
+enum CpuFeatureBits {
+    CPU_SSE2 = 1u << 4,
+    CPU_AVX = 1u << 9,
+    CPU_AVX2 = 1u << 10,
+    CPU_FMA = 1u << 14,
+    CPU_AVX512F = 1u << 15,
+    CPU_BMI = 1u << 16,
+    CPU_BMI2 = 1u << 17,
+    CPU_AVX512VL = 1u << 20,
+    CPU_AVX512BW = 1u << 21,
+    CPU_AVX512DQ = 1u << 22,
+    CPU_AVX512CD = 1u << 23,
+};
+
+static const TargetIsaInfo target_isas[] = {
+    {"sse", "b", "+sse2", "128", CPU_SSE2},
+    {"avx", "c", "+avx", "256", CPU_AVX},
+    {"avx2", "d", "+avx2,+fma,+bmi,+bmi2", "256",
+     CPU_AVX2 | CPU_FMA | CPU_BMI | CPU_BMI2},
+    {"avx512", "e",
+     "+avx2,+fma,+bmi,+bmi2,+avx512f,+avx512vl,+avx512bw,+avx512dq,+avx512cd",
+     "512",
+     CPU_AVX2 | CPU_FMA | CPU_BMI | CPU_BMI2 | CPU_AVX512F | CPU_AVX512VL |
+         CPU_AVX512BW | CPU_AVX512DQ | CPU_AVX512CD}};
+
+static const TargetIsaInfo* getTargetIsaInfo(const std::string& letter) {
+    for (const TargetIsaInfo& info : target_isas) {
+        if (letter == info.letter) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+bool parseTargetIsas(const std::string& list, std::vector<std::string>& isas) {
+    SmallVector<StringRef> names;
+    StringRef(list).split(names, ',');
+    isas.clear();
+    for (const TargetIsaInfo& info : target_isas) {
+        for (StringRef name : names) {
+            if (name.trim() == info.name) {
+                isas.push_back(info.letter);
+                break;
+            }
+        }
+    }
+    return isas.size() == names.size();
+}
+
 Function* ModuleVectorizer::createVectorFunction(Function* F, VFABI& vfabi) {
     PRINT_HIGH("Cloning scalar function " << *F << " with VFABI "
                                           << vfabi.toString());
@@ -120,6 +188,110 @@ Function* ModuleVectorizer::createVectorFunction(Function* F, VFABI& vfabi) {
     return VF;
 }
 
+/* The calls to functions without a vector variant for the shapes of their
+ * arguments are emitted once per active lane. Instead, the functions whose
+ * body is visible are cloned for the VFABI of the call site (uniform, linear
+ * and varying parameters, and mask) and vectorized like the "declare simd"
+ * functions, as long as they only contain what psv knows how to vectorize.
+ */
+static bool canCloneCalledFunction(Function* F, const VFABI& vfabi,
+                                   FunctionResolver& resolver) {
+    if (F->isDeclaration() || F->isIntrinsic() || F->isVarArg() ||
+        F->arg_size() != vfabi.parameters.size()) {
+        return false;
+    }
+
+    auto isVectorizableType = [](Type* ty) {
+        return ty->isVoidTy() || (ty->isSingleValueType() && !ty->isVectorTy());
+    };
+    if (!isVectorizableType(F->getReturnType())) {
+        return false;
+    }
+    for (Argument& arg : F->args()) {
+        if (arg.hasPassPointeeByValueCopyAttr() || arg.hasStructRetAttr() ||
+            (vfabi.parameters[arg.getArgNo()].is_varying &&
+             !isVectorizableType(arg.getType()))) {
+            return false;
+        }
+    }
+
+    for (Instruction& I : instructions(F)) {
+        CallBase* call = dyn_cast<CallBase>(&I);
+        if (call && call->getCalledFunction()) {
+            switch (resolver.getPsimApiEnum(call->getCalledFunction())) {
+                // only known by the entry points
+                case FunctionResolver::PsimApiEnum::GET_GANG_NUM:
+                case FunctionResolver::PsimApiEnum::GET_GRID_SIZE:
+                case FunctionResolver::PsimApiEnum::GET_THREAD_NUM:
+                    PRINT_HIGH("Not cloning " << F->getName() << ": " << I);
+                    return false;
+                default:
+                    break;
+            }
+        }
+
+        // the instructions handled by TransformStep::transformInstruction,
+        // and those removed by preprocessFunction
+        if (!isa<UnaryOperator>(I) && !isa<BinaryOperator>(I) &&
+            !isa<CastInst>(I) && !isa<CmpInst>(I) &&
+            !isa<GetElementPtrInst>(I) && !isa<SelectInst>(I) &&
+            !isa<FreezeInst>(I) && !isa<AllocaInst>(I) && !isa<LoadInst>(I) &&
+            !isa<StoreInst>(I) && !isa<BranchInst>(I) && !isa<SwitchInst>(I) &&
+            !isa<CallInst>(I) && !isa<InvokeInst>(I) && !isa<PHINode>(I) &&
+            !isa<ReturnInst>(I) && !isa<UnreachableInst>(I) &&
+            !isa<LandingPadInst>(I) && !isa<ResumeInst>(I)) {
+            PRINT_HIGH("Not cloning " << F->getName() << ": " << I);
+            return false;
+        }
+    }
+    return true;
+}
+
+FunctionResolution ModuleVectorizer::cloneCalledFunction(
+    Function* F, const VFABI& desired, MathAccuracy math_accuracy,
+    Function* caller) {
+    // recursive functions whose calls change the stride of their linear
+    // arguments would otherwise be cloned endlessly
+    const unsigned max_clones = 8;
+
+    if (!global_opts.clone_called_functions ||
+        entry_points.find(F) != entry_points.end() ||
+        num_called_function_clones[F] >= max_clones ||
+        !canCloneCalledFunction(F, desired, vm_info.function_resolver)) {
+        return {nullptr, VFABI()};
+    }
+    num_called_function_clones[F]++;
+
+    VFABI vfabi = desired;
+    vfabi.is_entry_point = false;
+    vfabi.is_declare_spmd = false;
+    // the math(...) clause of the region also applies to the functions it
+    // calls, so each accuracy gets its own clone
+    vfabi.mangled_name =
+        vfabi.toString() + "." + getMathAccuracyName(math_accuracy);
+    PRINT_LOW("Cloning called function " << F->getName() << " for VFABI \""
+                                         << vfabi.mangled_name << "\"");
+
+    Function* VF = createVectorFunction(F, vfabi);
+    VF->setLinkage(GlobalValue::InternalLinkage);
+    if (caller->hasFnAttribute("target-features")) {
+        VF->addFnAttr(caller->getFnAttribute("target-features"));
+    }
+    VF->addFnAttr("psim-math-accuracy", getMathAccuracyName(math_accuracy));
+    VectorizedFunctionInfo* vf_info =
+        new VectorizedFunctionInfo(vm_info, VF, vfabi);
+    vm_info.vfinfo_map[F].push_back(vf_info);
+    {
+        TimeReportScope scope(VF->getName().str(), "preprocessFunction");
+        preprocessFunction(VF);
+    }
+    called_function_clones.push_back({F, vf_info});
+
+    FunctionResolution resolution = {VF, vfabi, true, math_accuracy};
+    vm_info.function_resolver.add(F, resolution);
+    return resolution;
+}
+
 void ModuleVectorizer::setGridGangNum(CallInst* call,
                                       GridMetadata& grid_metadata) {
     Value* op = call->getOperand(0);
@@ -208,6 +380,50 @@ void ModuleVectorizer::setGridSubName(CallInst* call,
     PRINT_HIGH("Set grid sub name to " << grid_metadata.subname);
 }
 
+void ModuleVectorizer::setGridPrefetchDistance(CallInst* call,
+                                               GridMetadata& grid_metadata) {
+    ConstantInt* op = dyn_cast<ConstantInt>(call->getOperand(0));
+    if (!op) {
+        FATAL(
+            "Expected ConstantInt argument to "
+            "__psim_set_prefetch_distance; but received "
+            << *call->getOperand(0) << "\n");
+    }
+    if (grid_metadata.prefetch_distance >= 0) {
+        FATAL(
+            "Found more than one __psim_set_prefetch_distance() call "
+            "preceding a call to __kmpc_fork_call: "
+            << *call);
+    }
+    grid_metadata.prefetch_distance = op->getZExtValue();
+    grid_metadata.populated = true;
+
+    PRINT_HIGH("Set grid prefetch distance to "
+               << grid_metadata.prefetch_distance);
+}
+
+void ModuleVectorizer::setGridMathAccuracy(CallInst* call,
+                                           GridMetadata& grid_metadata) {
+    ConstantInt* op = dyn_cast<ConstantInt>(call->getOperand(0));
+    if (!op || op->getZExtValue() > MATH_APPROX) {
+        FATAL(
+            "Expected MathAccuracy ConstantInt argument to "
+            "__psim_set_math_accuracy; but received "
+            << *call->getOperand(0) << "\n");
+    }
+    if (grid_metadata.math_accuracy >= 0) {
+        FATAL(
+            "Found more than one __psim_set_math_accuracy() call "
+            "preceding a call to __kmpc_fork_call: "
+            << *call);
+    }
+    grid_metadata.math_accuracy = op->getZExtValue();
+    grid_metadata.populated = true;
+
+    PRINT_HIGH("Set grid math accuracy to " << getMathAccuracyName(
+                   (MathAccuracy)grid_metadata.math_accuracy));
+}
+
 void ModuleVectorizer::setGridOmpFunction(CallInst* call,
                                           GridMetadata& grid_metadata) {
     Value* omp_func_value = call->getOperand(2);
@@ -246,13 +462,28 @@ void ModuleVectorizer::finishGridMetadata(GridMetadata& grid_metadata) {
     // gang num is also implicitly 0 if it wasn't already set...no need to write
     // code for if (gang_num == 0) { gang_num = 0; }
 
-    grid_metadata.vfabi.isa = "e";  // FIXME
+    // initialize() vectorizes the entry point for each of the --isa ISAs
+    grid_metadata.vfabi.isa =
+        global_opts.isas.empty() ? "e" : global_opts.isas.back();
     grid_metadata.vfabi.mask = false;
     for (unsigned i = 0; i < grid_metadata.omp_func->arg_size(); i++) {
         // TODO extract alignment from fork_call arguments
         grid_metadata.vfabi.parameters.push_back(VFABIShape::Uniform());
     }
 
+    // read back by VectorizedFunctionInfo::getPrefetchDistance()
+    if (grid_metadata.prefetch_distance >= 0) {
+        grid_metadata.omp_func->addFnAttr(
+            "psim-prefetch-distance",
+            std::to_string(grid_metadata.prefetch_distance));
+    }
+    // read back by VectorizedFunctionInfo::getMathAccuracy()
+    if (grid_metadata.math_accuracy >= 0) {
+        grid_metadata.omp_func->addFnAttr(
+            "psim-math-accuracy",
+            getMathAccuracyName((MathAccuracy)grid_metadata.math_accuracy));
+    }
+
     grid_metadata.vfabi.scalar_name = grid_metadata.omp_func->getName();
     grid_metadata.vfabi.mangled_name = grid_metadata.vfabi.toString();
 }
@@ -290,6 +521,12 @@ void ModuleVectorizer::findPsimCalls(
                 } else if (name == "__psim_set_grid_sub_name") {
                     setGridSubName(call, grid_metadata);
                     insts_to_delete.insert(call);
+                } else if (name == "__psim_set_prefetch_distance") {
+                    setGridPrefetchDistance(call, grid_metadata);
+                    insts_to_delete.insert(call);
+                } else if (name == "__psim_set_math_accuracy") {
+                    setGridMathAccuracy(call, grid_metadata);
+                    insts_to_delete.insert(call);
                 } else if (name == "__kmpc_fork_call") {
                     PRINT_HIGH("Found call to __kmpc_fork_call: " << I);
                     if (!grid_metadata.populated) {
@@ -449,7 +686,10 @@ void ModuleVectorizer::preprocessFunction(Function* F) {
 }
 
 void ModuleVectorizer::initialize() {
-    findPSVEntryPoints();
+    {
+        TimeReportScope scope("<module>", "findPSVEntryPoints");
+        findPSVEntryPoints();
+    }
 
     // Store the list of original functions in a vector so that we don't try
     // to recursively analyze functions we've generated and which have been
@@ -465,7 +705,15 @@ void ModuleVectorizer::initialize() {
 
         auto i = entry_points.find(F);
         if (i != entry_points.end()) {
-            vfabis.push_back(i->second);
+            if (global_opts.isas.empty()) {
+                vfabis.push_back(i->second);
+            }
+            for (const std::string& isa : global_opts.isas) {
+                VFABI vfabi = i->second;
+                vfabi.isa = isa;
+                vfabi.mangled_name = vfabi.toString();
+                vfabis.push_back(vfabi);
+            }
         } else {
             getFunctionVFABIs(F, vfabis);
         }
@@ -479,12 +727,16 @@ void ModuleVectorizer::initialize() {
             PRINT_LOW("Analyzing VFABI \"" << vfabi.mangled_name << "\"");
 
             Function* VF = createVectorFunction(F, vfabi);
+            if (vfabi.is_entry_point && !global_opts.isas.empty()) {
+                setTargetIsa(VF, vfabi.isa);
+            }
             VectorizedFunctionInfo* vf_info =
                 new VectorizedFunctionInfo(vm_info, VF, vfabi);
             vf_info->VF = VF;
             vf_info->vfabi = vfabi;
             vm_info.vfinfo_map[F].push_back(vf_info);
 
+            TimeReportScope scope(VF->getName().str(), "preprocessFunction");
             preprocessFunction(VF);
         }
     }
@@ -502,22 +754,357 @@ void ModuleVectorizer::vectorizeFunctions() {
             }
         }
     }
+
+    // collect the functions to vectorize in module order so that the
+    // diagnostics and the output module do not depend on the map order
+    std::vector<std::pair<Function*, VectorizedFunctionInfo*>> jobs;
+    for (Function& F : vm_info.mod->functions()) {
+        auto it = vm_info.vfinfo_map.find(&F);
+        if (it == vm_info.vfinfo_map.end()) {
+            continue;
+        }
+        for (VectorizedFunctionInfo* vf_info : it->second) {
+            jobs.push_back({&F, vf_info});
+        }
+    }
+
+    unsigned num_threads = global_opts.num_jobs;
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (num_threads > 1 &&
+        (global_opts.add_prints || global_opts.scalable_size)) {
+        // these modes create named globals whose names depend on the
+        // order of creation
+        PRINT_LOW("Vectorizing functions sequentially");
+        num_threads = 1;
+    }
+
+    typedef std::vector<std::pair<Function*, VectorizedFunctionInfo*>> Jobs;
+    auto vectorize = [&](Jobs& batch) {
+        std::unordered_set<Function*> old_functions;
+        for (Function& F : vm_info.mod->functions()) {
+            old_functions.insert(&F);
+        }
+        if (num_threads > 1 && batch.size() > 1) {
+            vectorizeFunctionsConcurrently(
+                batch, std::min<size_t>(num_threads, batch.size()));
+        } else {
+            for (auto& job : batch) {
+                FunctionVectorizer(*job.second).vectorize();
+            }
+        }
+        sortNewFunctions(old_functions);
+    };
+    // the clones of the called functions (see cloneCalledFunction), and the
+    // clones that these call in turn
+    auto vectorizeClones = [&]() {
+        while (!called_function_clones.empty()) {
+            Jobs batch;
+            batch.swap(called_function_clones);
+            // requested in scheduling order with psv -j
+            std::sort(batch.begin(), batch.end(),
+                      [](const Jobs::value_type& a, const Jobs::value_type& b) {
+                          return a.second->VF->getName() <
+                                 b.second->VF->getName();
+                      });
+            vectorize(batch);
+            jobs.insert(jobs.end(), batch.begin(), batch.end());
+        }
+    };
+
     // vectorize all the functions
-    for (auto& i : vm_info.vfinfo_map) {
-        Function* F = i.first;
-        for (VectorizedFunctionInfo* vf_info : i.second) {
-            FunctionVectorizer(*vf_info).vectorize();
+    vectorize(jobs);
+    vectorizeClones();
 
-            if (vf_info->vfabi.is_entry_point) {
-                assert(i.second.size() == 1);
+    if (global_opts.versioning) {
+        size_t num_jobs = jobs.size();
+        for (size_t i = 0; i < num_jobs; i++) {
+            versionFunction(jobs[i].first, jobs[i].second);
+        }
+        // the unit stride clones may call other variants
+        vectorizeClones();
+    }
+
+    std::unordered_set<Function*> replaced_entry_points;
+    for (auto& job : jobs) {
+        Function* F = job.first;
+        VectorizedFunctionInfo* vf_info = job.second;
+        if (vf_info->vfabi.is_entry_point &&
+            replaced_entry_points.insert(F).second) {
+            std::vector<VectorizedFunctionInfo*>& versions =
+                vm_info.vfinfo_map[F];
+            if (versions.size() == 1) {
                 PRINT_LOW("Replacing all uses of " << F->getName() << " with "
                                                    << vf_info->VF->getName());
                 F->replaceAllUsesWith(vf_info->VF);
-                F->eraseFromParent();
+            } else {
+                dispatchIsaVersions(F, versions);
             }
+            F->eraseFromParent();
+        }
+
+        printDiagnostics(vf_info);
+    }
+}
+
+/* Entry points vectorized for a given --isa are compiled with the target
+ * features of that ISA, independently of the features (-march) of the rest of
+ * the translation unit. They must then not be inlined into their callers.
+ */
+void ModuleVectorizer::setTargetIsa(Function* VF, const std::string& isa) {
+    const TargetIsaInfo* info = getTargetIsaInfo(isa);
+    assert(info);
+
+    std::string features = info->target_features;
+    Attribute attr = VF->getFnAttribute("target-features");
+    if (attr.isValid() && !attr.getValueAsString().empty()) {
+        features = attr.getValueAsString().str() + "," + features;
+    }
+    VF->addFnAttr("target-features", features);
+    VF->addFnAttr("prefer-vector-width", info->prefer_vector_width);
+    VF->addFnAttr("min-legal-vector-width", info->prefer_vector_width);
+    VF->removeFnAttr(Attribute::AlwaysInline);
+    VF->addFnAttr(Attribute::NoInline);
+}
 
-            printDiagnostics(vf_info);
+/* Entry points vectorized for several ISAs are called through a function
+ * pointer. A constructor selects the widest version supported by the CPU, or
+ * the narrowest one if none is, and stores it in the pointer before main()
+ * and the other constructors run; the pointer starts out at the narrowest
+ * version for the code that runs even earlier. The CPU features are read
+ * from __cpu_model as done by __builtin_cpu_supports(). Each function that
+ * launches F loads the pointer once at its entry, so the gangs of a launch
+ * make an indirect call but don't check the CPU again.
+ */
+void ModuleVectorizer::dispatchIsaVersions(
+    Function* F, std::vector<VectorizedFunctionInfo*>& versions) {
+    // narrowest ISA first
+    std::vector<VectorizedFunctionInfo*> sorted = versions;
+    std::sort(sorted.begin(), sorted.end(),
+              [](VectorizedFunctionInfo* a, VectorizedFunctionInfo* b) {
+                  return getTargetIsaInfo(a->vfabi.isa) <
+                         getTargetIsaInfo(b->vfabi.isa);
+              });
+
+    FunctionType* FT = sorted[0]->VF->getFunctionType();
+    PointerType* ptr_ty = FT->getPointerTo();
+    GlobalVariable* cache = new GlobalVariable(
+        *vm_info.mod, ptr_ty, false, GlobalValue::InternalLinkage,
+        sorted[0]->VF, F->getName() + ".dispatch.cache");
+    Align align = vm_info.mod->getDataLayout().getPointerABIAlignment(0);
+
+    Function* resolver = Function::Create(
+        FunctionType::get(Type::getVoidTy(vm_info.ctx), false),
+        GlobalValue::InternalLinkage, F->getName() + ".dispatch.resolve",
+        vm_info.mod);
+    IRBuilder<> builder(BasicBlock::Create(vm_info.ctx, "entry", resolver));
+    Type* i32 = builder.getInt32Ty();
+    builder.CreateCall(vm_info.mod->getOrInsertFunction(
+        "__cpu_indicator_init", FunctionType::get(builder.getVoidTy(), false)));
+    StructType* cpu_model_ty =
+        StructType::get(vm_info.ctx, {i32, i32, i32, ArrayType::get(i32, 1)});
+    Constant* cpu_model =
+        vm_info.mod->getOrInsertGlobal("__cpu_model", cpu_model_ty);
+    Value* features = builder.CreateLoad(
+        i32, builder.CreateInBoundsGEP(cpu_model_ty, cpu_model,
+                                       {builder.getInt32(0),
+                                        builder.getInt32(3),
+                                        builder.getInt32(0)}));
+    Value* selected = sorted[0]->VF;
+    for (size_t i = 1; i < sorted.size(); i++) {
+        Constant* required = builder.getInt32(
+            getTargetIsaInfo(sorted[i]->vfabi.isa)->cpu_features);
+        Value* supported = builder.CreateICmpEQ(
+            builder.CreateAnd(features, required), required);
+        selected = builder.CreateSelect(supported, sorted[i]->VF, selected);
+    }
+    builder.CreateAlignedStore(selected, cache, align);
+    builder.CreateRetVoid();
+    // before the default priority (65535) constructors, which may launch
+    // regions
+    appendToGlobalCtors(*vm_info.mod, resolver, 101);
+    PRINT_MID("Generated ISA dispatcher " << *resolver);
+
+    // each caller loads the pointer once, in its entry block
+    std::unordered_map<Function*, Value*> callees;
+    for (User* U : make_early_inc_range(F->users())) {
+        CallInst* call = dyn_cast<CallInst>(U);
+        if (!call || call->getCalledOperand() != F) {
+            FATAL("Unexpected use of entry point " << F->getName() << ": "
+                                                   << *U);
+        }
+        Function* caller = call->getFunction();
+        Value*& callee = callees[caller];
+        if (!callee) {
+            builder.SetInsertPoint(
+                &*caller->getEntryBlock().getFirstInsertionPt());
+            callee = builder.CreateAlignedLoad(ptr_ty, cache, align,
+                                               F->getName() + ".dispatch");
         }
+        call->setCalledFunction(FT, callee);
+        PRINT_LOW("Calling " << F->getName() << " through " << *callee);
+    }
+}
+
+static size_t countGathersScatters(VectorizedFunctionInfo* vf_info) {
+    size_t n = 0;
+    for (auto& i : vf_info->diagnostics.gathers) {
+        n += i.second.size();
+    }
+    for (auto& i : vf_info->diagnostics.scatters) {
+        n += i.second.size();
+    }
+    return n;
+}
+
+/* Strides which depend on runtime values (e.g., an image row stride, or a
+ * uniform argument multiplied by the lane number) make the address shapes
+ * varying, and the accesses are emitted as gathers and scatters. Such
+ * functions are vectorized a second time from the scalar function F, with
+ * the uniform values feeding the gathered addresses assumed to be 1. If that
+ * removes gathers or scatters, VF becomes a dispatcher which checks the
+ * assumption at runtime and calls either the unit-stride clone or the
+ * original vectorized body. Both are always inlined into VF.
+ */
+void ModuleVectorizer::versionFunction(Function* F,
+                                       VectorizedFunctionInfo* vf_info) {
+    if (vf_info->version_candidates.empty()) {
+        return;
+    }
+    Function* VF = vf_info->VF;
+    PRINT_LOW("Versioning " << VF->getName() << " on "
+                            << vf_info->version_candidates.size()
+                            << " unit stride assumptions");
+
+    Function* VS = createVectorFunction(F, vf_info->vfabi);
+    VS->setName(VF->getName() + ".unit_stride");
+    VS->setLinkage(GlobalValue::InternalLinkage);
+    if (VF->hasFnAttribute("target-features")) {
+        VS->addFnAttr(VF->getFnAttribute("target-features"));
+    }
+    VectorizedFunctionInfo* vs_info =
+        new VectorizedFunctionInfo(vm_info, VS, vf_info->vfabi);
+    vs_info->version_assumptions = vf_info->version_candidates;
+    {
+        TimeReportScope scope(VS->getName().str(), "preprocessFunction");
+        preprocessFunction(VS);
+    }
+    FunctionVectorizer(*vs_info).vectorize();
+
+    size_t num_generic = countGathersScatters(vf_info);
+    size_t num_versioned = countGathersScatters(vs_info);
+    delete vs_info;
+    if (num_versioned >= num_generic) {
+        PRINT_LOW("Versioning doesn't remove any gather/scatter, dropping "
+                  << VS->getName());
+        VS->eraseFromParent();
+        return;
+    }
+    PRINT_LOW("Versioning removes " << num_generic - num_versioned << " of "
+                                    << num_generic << " gathers/scatters");
+
+    // Move the original vectorized body to a new function
+    Function* fallback =
+        Function::Create(VF->getFunctionType(), GlobalValue::InternalLinkage,
+                         VF->getName() + ".fallback", vm_info.mod);
+    fallback->copyAttributesFrom(VF);
+    fallback->setLinkage(GlobalValue::InternalLinkage);
+    if (fallback->hasFnAttribute(Attribute::NoInline) &&
+        !fallback->hasFnAttribute(Attribute::OptimizeNone)) {
+        // VF may not be inlined into its callers (see setTargetIsa), but its
+        // body is inlined into VF
+        fallback->removeFnAttr(Attribute::NoInline);
+        fallback->addFnAttr(Attribute::AlwaysInline);
+    }
+    fallback->getBasicBlockList().splice(fallback->end(),
+                                         VF->getBasicBlockList());
+    for (unsigned i = 0; i < VF->arg_size(); i++) {
+        fallback->getArg(i)->setName(VF->getArg(i)->getName());
+        VF->getArg(i)->replaceAllUsesWith(fallback->getArg(i));
+    }
+
+    // VF checks the assumptions and dispatches
+    BasicBlock* entry = BasicBlock::Create(vm_info.ctx, "entry", VF);
+    BasicBlock* unit_stride =
+        BasicBlock::Create(vm_info.ctx, "unit_stride", VF);
+    BasicBlock* generic = BasicBlock::Create(vm_info.ctx, "generic", VF);
+
+    IRBuilder<> builder(entry);
+    Value* cond = builder.getTrue();
+    for (auto& vv : vf_info->version_candidates) {
+        Value* v = VF->getArg(vv.arg);
+        if (vv.load_type) {
+            v = builder.CreateLoad(vv.load_type, v);
+        }
+        cond = builder.CreateAnd(
+            cond, builder.CreateICmpEQ(v, ConstantInt::get(v->getType(), 1)));
+    }
+    builder.CreateCondBr(cond, unit_stride, generic);
+
+    std::vector<Value*> args;
+    for (Argument& arg : VF->args()) {
+        args.push_back(&arg);
+    }
+    for (auto i : {std::make_pair(unit_stride, VS),
+                   std::make_pair(generic, fallback)}) {
+        builder.SetInsertPoint(i.first);
+        CallInst* call = builder.CreateCall(i.second, args);
+        if (VF->getReturnType()->isVoidTy()) {
+            builder.CreateRetVoid();
+        } else {
+            builder.CreateRet(call);
+        }
+    }
+
+    PRINT_MID("Generated versioned function " << *VF);
+}
+
+void ModuleVectorizer::vectorizeFunctionsConcurrently(
+    std::vector<std::pair<Function*, VectorizedFunctionInfo*>>& jobs,
+    unsigned num_threads) {
+    PRINT_LOW("Vectorizing " << jobs.size() << " functions on " << num_threads
+                             << " threads");
+
+    // Each thread holds the module lock while vectorizing; the lock is
+    // released around z3 queries (see ModuleUnlockGuard), which is where
+    // vectorization spends most of its time
+    vm_info.concurrent = true;
+    std::atomic<size_t> next_job(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+                std::lock_guard<std::mutex> guard(vm_info.llvm_mutex);
+                FunctionVectorizer(*jobs[i].second).vectorize();
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    vm_info.concurrent = false;
+}
+
+/* Functions and declarations created while vectorizing (clones, intrinsics,
+ * vector math functions) are appended in creation order, which depends on
+ * the scheduling of the threads with -j. Sort them by name, for every -j. */
+void ModuleVectorizer::sortNewFunctions(
+    const std::unordered_set<Function*>& old_functions) {
+    std::vector<Function*> new_functions;
+    for (Function& F : vm_info.mod->functions()) {
+        if (old_functions.find(&F) == old_functions.end()) {
+            new_functions.push_back(&F);
+        }
+    }
+    std::sort(new_functions.begin(), new_functions.end(),
+              [](Function* a, Function* b) {
+                  return a->getName() < b->getName();
+              });
+    auto& function_list = vm_info.mod->getFunctionList();
+    for (Function* F : new_functions) {
+        function_list.splice(function_list.end(), function_list,
+                             F->getIterator());
     }
 }
 
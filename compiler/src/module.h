@@ -20,13 +20,27 @@ namespace ps {
 
 extern unsigned module_verbosity_level;
 
+// Parses a comma separated list of ISA names (e.g. "avx2,avx512") into VFABI
+// isa letters, sorted from the narrowest to the widest ISA
+bool parseTargetIsas(const std::string& list, std::vector<std::string>& isas);
+
 class ModuleVectorizer {
   public:
-    ModuleVectorizer(VectorizedModuleInfo& vm_info) : vm_info(vm_info) {}
+    ModuleVectorizer(VectorizedModuleInfo& vm_info) : vm_info(vm_info) {
+        vm_info.module_vectorizer = this;
+    }
     void initialize();
     void vectorizeFunctions();
     void writeToFile(const std::string& fileName);
 
+    // Clones F for desired and math_accuracy and registers the clone in the
+    // function resolver; it is vectorized after its callers. Returns
+    // {nullptr, ...} if F can't be vectorized.
+    FunctionResolution cloneCalledFunction(llvm::Function* F,
+                                           const VFABI& desired,
+                                           MathAccuracy math_accuracy,
+                                           llvm::Function* caller);
+
   private:
     VectorizedModuleInfo& vm_info;
 
@@ -44,14 +58,25 @@ class ModuleVectorizer {
         llvm::Value* gang_num;
         llvm::Value* grid_size;
         std::string subname;
+        int prefetch_distance = -1;
+        int math_accuracy = -1;
     };
 
     std::unordered_map<llvm::Function*, VFABI> entry_points;
 
+    // clones of the called functions waiting to be vectorized
+    std::vector<std::pair<llvm::Function*, VectorizedFunctionInfo*>>
+        called_function_clones;
+    std::unordered_map<llvm::Function*, unsigned> num_called_function_clones;
+
     void setGridGangNum(llvm::CallInst* inst, GridMetadata& launch_metadata);
     void setGridGangSize(llvm::CallInst* inst, GridMetadata& launch_metadata);
     void setGridSize(llvm::CallInst* inst, GridMetadata& launch_metadata);
     void setGridSubName(llvm::CallInst* inst, GridMetadata& launch_metadata);
+    void setGridPrefetchDistance(llvm::CallInst* inst,
+                                 GridMetadata& launch_metadata);
+    void setGridMathAccuracy(llvm::CallInst* inst,
+                             GridMetadata& launch_metadata);
 
     void setGridOmpFunction(llvm::CallInst* inst,
                             GridMetadata& launch_metadata);
@@ -63,6 +88,18 @@ class ModuleVectorizer {
         std::unordered_map<llvm::CallInst*, GridMetadata>& launches);
     void findPSVEntryPoints();
 
+    void vectorizeFunctionsConcurrently(
+        std::vector<std::pair<llvm::Function*, VectorizedFunctionInfo*>>& jobs,
+        unsigned num_threads);
+    void sortNewFunctions(
+        const std::unordered_set<llvm::Function*>& old_functions);
+
+    void versionFunction(llvm::Function* F, VectorizedFunctionInfo* vf_info);
+
+    void setTargetIsa(llvm::Function* VF, const std::string& isa);
+    void dispatchIsaVersions(llvm::Function* F,
+                             std::vector<VectorizedFunctionInfo*>& versions);
+
     void preprocessFunction(llvm::Function* VF);
     void replaceUnreachableInsts(llvm::Function* F);
 };
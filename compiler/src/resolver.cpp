@@ -11,6 +11,7 @@
 
 #include "resolver.h"
 
+#include <llvm/ADT/Triple.h>
 #include <llvm/Analysis/VectorUtils.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Intrinsics.h>
@@ -26,7 +27,8 @@ unsigned resolver_verbosity_level;
 [[maybe_unused]] static unsigned& verbosity_level = resolver_verbosity_level;
 
 FunctionResolution FunctionResolver::getBestVFABIMatch(
-    std::vector<FunctionResolution>& resolutions, VFABI& desired) {
+    std::vector<FunctionResolution>& resolutions, VFABI& desired,
+    MathAccuracy math_accuracy) {
     PRINT_HIGH("Considering " << resolutions.size() << " resolutions");
 
     // Find all functionally compatible VFABIs
@@ -41,6 +43,11 @@ FunctionResolution FunctionResolver::getBestVFABIMatch(
             PRINT_HIGH("VFABI " << vfabi.toString() << " is incompatible");
             continue;
         }
+        if (resolution.is_clone && resolution.math_accuracy != math_accuracy) {
+            PRINT_HIGH("VFABI " << vfabi.toString()
+                                << " is incompatible due to math accuracy");
+            continue;
+        }
 
         bool incompatible = false;
         if (vfabi.parameters.size() != desired.parameters.size()) {
@@ -48,8 +55,12 @@ FunctionResolution FunctionResolver::getBestVFABIMatch(
                   << "expected argument count");
         }
         for (unsigned i = 0; i < vfabi.parameters.size(); i++) {
-            if (desired.parameters[i].is_varying &&
-                !vfabi.parameters[i].is_varying) {
+            // a varying parameter accepts any argument, a uniform or linear
+            // one only the arguments of the same stride
+            const VFABIShape& provided = vfabi.parameters[i];
+            const VFABIShape& wanted = desired.parameters[i];
+            if (!provided.is_varying &&
+                (wanted.is_varying || wanted.stride != provided.stride)) {
                 PRINT_HIGH("VFABI " << vfabi.toString()
                                     << " is incompatible due to parameter "
                                     << i);
@@ -82,13 +93,24 @@ FunctionResolution FunctionResolver::getBestVFABIMatch(
         return {nullptr, VFABI()};
     }
 
-    // Pick the best candidate
-    // For now, there should only be one candidate, because so far we are
-    // checking for exact matches of isa, mask, and vlen
-    if (candidates.size() > 1) {
-        FATAL("More than one legal function resolution candidate");
+    // Pick the best candidate: with the variants cloned for the call sites
+    // (see ModuleVectorizer::cloneCalledFunction), e.g. "vv" and "uv", several
+    // may accept the arguments. The one with the fewest varying parameters
+    // is the exact match if there is one.
+    auto num_varying = [](const VFABI& vfabi) {
+        unsigned n = 0;
+        for (const VFABIShape& p : vfabi.parameters) {
+            n += p.is_varying;
+        }
+        return n;
+    };
+    FunctionResolution* best = &candidates[0];
+    for (FunctionResolution& candidate : candidates) {
+        if (num_varying(candidate.vfabi) < num_varying(best->vfabi)) {
+            best = &candidate;
+        }
     }
-    return candidates[0];
+    return *best;
 }
 
 void FunctionResolver::add(Function* f, FunctionResolution resolution) {
@@ -109,7 +131,93 @@ FunctionResolver::PsimApiEnum FunctionResolver::getPsimApiEnum(
     return PSIM_API_NONE;
 }
 
-FunctionResolution FunctionResolver::get(Function* f, VFABI& desired) {
+FunctionResolver::TargetIsa FunctionResolver::getTargetIsa(
+    Function* f, const VFABI& vfabi) {
+    if (!Triple(f->getParent()->getTargetTriple()).isX86()) {
+        return ISA_GENERIC;
+    }
+
+    // VFABI x86 ISA letters: b = SSE, c = AVX, d = AVX2, e = AVX-512
+    TargetIsa isa = ISA_GENERIC;
+    if (vfabi.isa == "e") {
+        isa = ISA_AVX512;
+    } else if (vfabi.isa == "d") {
+        isa = ISA_AVX2;
+    } else if (vfabi.isa == "b" || vfabi.isa == "c") {
+        // AVX has no 256-bit integer instructions
+        isa = ISA_SSE;
+    }
+
+    Attribute attr = f->getFnAttribute("target-features");
+    if (attr.isValid()) {
+        StringRef features = attr.getValueAsString();
+        TargetIsa feature_isa = ISA_GENERIC;
+        if (features.contains("+avx512bw")) {
+            feature_isa = ISA_AVX512;
+        } else if (features.contains("+avx2")) {
+            feature_isa = ISA_AVX2;
+        } else if (features.contains("+sse2")) {
+            feature_isa = ISA_SSE;
+        }
+        isa = std::min(isa, feature_isa);
+    }
+
+    PRINT_HIGH("Target ISA of " << f->getName() << " is " << isa);
+    return isa;
+}
+
+bool FunctionResolver::hasTargetFeature(Function* f, StringRef feature) {
+    Attribute attr = f->getFnAttribute("target-features");
+    if (!attr.isValid()) {
+        return false;
+    }
+    // a later "+x" or "-x" overrides an earlier one
+    SmallVector<StringRef, 32> features;
+    attr.getValueAsString().split(features, ',', -1, false);
+    bool enabled = false;
+    for (StringRef token : features) {
+        if (token.drop_front() == feature.drop_front()) {
+            enabled = token == feature;
+        }
+    }
+    return enabled;
+}
+
+bool FunctionResolver::getTargetIntrinsic(PsimApiEnum api, TargetIsa isa,
+                                          unsigned num_lanes,
+                                          TargetIntrinsic& ret) {
+    for (int i = isa; i > ISA_GENERIC; i--) {
+        TargetIntrinsicMap& map = IsaIntrinsicMaps[(TargetIsa)i];
+        auto it = map.find(api);
+        if (it != map.end() && num_lanes % it->second.nelem == 0) {
+            ret = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FunctionResolver::getPermuteIntrinsic(Function* f, TargetIsa isa,
+                                           unsigned elem_bits,
+                                           bool two_sources,
+                                           PermuteIntrinsic& ret) {
+    for (int i = isa; i > ISA_GENERIC; i--) {
+        for (PermuteIntrinsic& p : IsaPermuteIntrinsics[(TargetIsa)i]) {
+            if (p.elem_bits != elem_bits || p.two_sources != two_sources) {
+                continue;
+            }
+            if (p.feature && !hasTargetFeature(f, p.feature)) {
+                continue;
+            }
+            ret = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+FunctionResolution FunctionResolver::get(Function* f, VFABI& desired,
+                                         MathAccuracy math_accuracy) {
     PRINT_HIGH("Resolving function " << f << " " << f->getName()
                                      << " for VFABI " << desired.toString());
     auto it = resolver_map.find(f);
@@ -120,7 +228,7 @@ FunctionResolution FunctionResolver::get(Function* f, VFABI& desired) {
     }
 
     PRINT_HIGH("Resolver cache hit");
-    return getBestVFABIMatch(it->second, desired);
+    return getBestVFABIMatch(it->second, desired, math_accuracy);
 }
 
 }  // namespace ps
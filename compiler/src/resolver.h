@@ -19,6 +19,7 @@
 
 #include <llvm/IR/IntrinsicsX86.h>
 
+#include "utils.h"
 #include "vfabi.h"
 
 namespace ps {
@@ -28,6 +29,11 @@ extern unsigned resolver_verbosity_level;
 struct FunctionResolution {
     llvm::Function* function;
     VFABI vfabi;
+    // cloned for a call site (see ModuleVectorizer::cloneCalledFunction)
+    bool is_clone = false;
+    // accuracy of the vector math functions of a clone, which only resolves
+    // the calls of functions with the same accuracy
+    MathAccuracy math_accuracy = MATH_PRECISE;
 };
 
 typedef std::unordered_map<llvm::Function*, std::vector<FunctionResolution>>
@@ -37,7 +43,8 @@ class FunctionResolver {
   public:
     FunctionResolver() {}
 
-    FunctionResolution get(llvm::Function* f, VFABI& desired);
+    FunctionResolution get(llvm::Function* f, VFABI& desired,
+                           MathAccuracy math_accuracy);
     void add(llvm::Function* f, FunctionResolution resolution);
 
     enum PsimApiEnum {
@@ -58,6 +65,22 @@ class FunctionResolver {
         GANG_SYNC,
         ATOMICADD_LOCAL,
         COLLECTIVE_ADD_ABS_DIFF,
+        REDUCE_ADD_SYNC,
+        REDUCE_MIN_SYNC,
+        REDUCE_MAX_SYNC,
+        REDUCE_AND_SYNC,
+        REDUCE_OR_SYNC,
+        SCAN_ADD_SYNC,
+        SCAN_MIN_SYNC,
+        SCAN_MAX_SYNC,
+        COMPRESS_STORE,
+        EXPAND_LOAD,
+        BALLOT_SYNC,
+        ANY_SYNC,
+        ALL_SYNC,
+        POPC_SYNC,
+        FIRST_ACTIVE_LANE,
+        NONTEMPORAL,
         PSIM_API_NONE,
     };
     PsimApiEnum getPsimApiEnum(llvm::Function* f);
@@ -79,7 +102,23 @@ class FunctionResolver {
         {ZIP_SYNC, "psim_zip_sync"},
         {GANG_SYNC, "psim_gang_sync"},
         {UNZIP_SYNC, "psim_unzip_sync"},
-        {ATOMICADD_LOCAL, "psim_atomic_add_local"}};
+        {ATOMICADD_LOCAL, "psim_atomic_add_local"},
+        {REDUCE_ADD_SYNC, "psim_reduce_add_sync"},
+        {REDUCE_MIN_SYNC, "psim_reduce_min_sync"},
+        {REDUCE_MAX_SYNC, "psim_reduce_max_sync"},
+        {REDUCE_AND_SYNC, "psim_reduce_and_sync"},
+        {REDUCE_OR_SYNC, "psim_reduce_or_sync"},
+        {SCAN_ADD_SYNC, "psim_scan_add_sync"},
+        {SCAN_MIN_SYNC, "psim_scan_min_sync"},
+        {SCAN_MAX_SYNC, "psim_scan_max_sync"},
+        {COMPRESS_STORE, "psim_compress_store"},
+        {EXPAND_LOAD, "psim_expand_load"},
+        {BALLOT_SYNC, "psim_ballot_sync"},
+        {ANY_SYNC, "psim_any_sync"},
+        {ALL_SYNC, "psim_all_sync"},
+        {POPC_SYNC, "psim_popc_sync"},
+        {FIRST_ACTIVE_LANE, "psim_first_active_lane"},
+        {NONTEMPORAL, "psim_nontemporal"}};
 
     std::unordered_map<PsimApiEnum, llvm::Intrinsic::ID> LlvmInstrinsicMap =
         {{UADD_SAT, llvm::Intrinsic::uadd_sat},
@@ -87,16 +126,86 @@ class FunctionResolver {
          {USUB_SAT, llvm::Intrinsic::usub_sat},
          {SSUB_SAT, llvm::Intrinsic::ssub_sat}};
 
-    std::unordered_map<PsimApiEnum, llvm::Intrinsic::ID>
-        Avx512InstrinsicMap = {
-            {UMULH, llvm::Intrinsic::x86_avx512_pmulhu_w_512},
-            {COLLECTIVE_ADD_ABS_DIFF, llvm::Intrinsic::x86_avx512_psad_bw_512}};
+    // Target-specific intrinsics for the psim APIs that have no generic LLVM
+    // IR equivalent. nelem is the number of elements of the intrinsic
+    // operands; wider gangs are split into chunks of nelem lanes.
+    enum TargetIsa { ISA_GENERIC, ISA_SSE, ISA_AVX2, ISA_AVX512 };
+    struct TargetIntrinsic {
+        llvm::Intrinsic::ID id;
+        unsigned nelem;
+    };
+    typedef std::unordered_map<PsimApiEnum, TargetIntrinsic> TargetIntrinsicMap;
+
+    std::unordered_map<TargetIsa, TargetIntrinsicMap> IsaIntrinsicMaps = {
+        {ISA_AVX512,
+         {{UMULH, {llvm::Intrinsic::x86_avx512_pmulhu_w_512, 32}},
+          {COLLECTIVE_ADD_ABS_DIFF,
+           {llvm::Intrinsic::x86_avx512_psad_bw_512, 64}}}},
+        {ISA_AVX2,
+         {{UMULH, {llvm::Intrinsic::x86_avx2_pmulhu_w, 16}},
+          {COLLECTIVE_ADD_ABS_DIFF, {llvm::Intrinsic::x86_avx2_psad_bw, 32}}}},
+        {ISA_SSE,
+         {{UMULH, {llvm::Intrinsic::x86_sse2_pmulhu_w, 8}},
+          {COLLECTIVE_ADD_ABS_DIFF, {llvm::Intrinsic::x86_sse2_psad_bw, 16}}}}};
+
+    // Variable permutes of nelem elements of elem_bits bits, used by
+    // psim_shuffle_sync with varying lane indices. The two-source permutes
+    // (vpermi2*) select from the concatenation of two vectors. feature is a
+    // target feature required in addition to the ISA, if any.
+    struct PermuteIntrinsic {
+        llvm::Intrinsic::ID id;
+        unsigned nelem;
+        unsigned elem_bits;
+        bool two_sources;
+        const char* feature;
+    };
+
+    std::unordered_map<TargetIsa, std::vector<PermuteIntrinsic>>
+        IsaPermuteIntrinsics = {
+            {ISA_AVX512,
+             {{llvm::Intrinsic::x86_avx512_permvar_qi_512, 64, 8, false,
+               "+avx512vbmi"},
+              {llvm::Intrinsic::x86_avx512_vpermi2var_qi_512, 64, 8, true,
+               "+avx512vbmi"},
+              {llvm::Intrinsic::x86_avx512_permvar_hi_512, 32, 16, false,
+               nullptr},
+              {llvm::Intrinsic::x86_avx512_vpermi2var_hi_512, 32, 16, true,
+               nullptr},
+              {llvm::Intrinsic::x86_avx512_permvar_si_512, 16, 32, false,
+               nullptr},
+              {llvm::Intrinsic::x86_avx512_vpermi2var_d_512, 16, 32, true,
+               nullptr}}},
+            {ISA_AVX2,
+             {{llvm::Intrinsic::x86_avx2_permd, 8, 32, false, nullptr}}},
+            {ISA_SSE,
+             {{llvm::Intrinsic::x86_ssse3_pshuf_b_128, 16, 8, false,
+               "+ssse3"}}}};
+
+    // The ISA of f is the one of its VFABI, capped by the "target-features"
+    // of f when present
+    static TargetIsa getTargetIsa(llvm::Function* f, const VFABI& vfabi);
+
+    // True if the "target-features" of f enable feature, e.g. "+avx512vbmi"
+    static bool hasTargetFeature(llvm::Function* f, llvm::StringRef feature);
+
+    // Looks for the widest intrinsic of isa or of a narrower ISA whose width
+    // divides num_lanes. Returns false if the API must be lowered to generic
+    // LLVM IR instead.
+    bool getTargetIntrinsic(PsimApiEnum api, TargetIsa isa, unsigned num_lanes,
+                            TargetIntrinsic& ret);
+
+    // Looks for the widest permute of isa or of a narrower ISA that f
+    // supports. Returns false if there is none.
+    bool getPermuteIntrinsic(llvm::Function* f, TargetIsa isa,
+                             unsigned elem_bits, bool two_sources,
+                             PermuteIntrinsic& ret);
 
   private:
     ResolverMap resolver_map;
 
     FunctionResolution getBestVFABIMatch(
-        std::vector<FunctionResolution>& resolutions, VFABI& desired);
+        std::vector<FunctionResolution>& resolutions, VFABI& desired,
+        MathAccuracy math_accuracy);
 };
 
 }  // namespace ps
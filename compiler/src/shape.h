@@ -35,12 +35,35 @@ struct MemInstMappedShape {
         ALREADY_PACKED,
         PACKED_SHUFFLE,
         GLOBAL_VALUE,
-        GATHER_SCATTER
+        GATHER_SCATTER,
+        INTERLEAVED
     } mapped_shape;
     uint64_t elem_size;
     std::vector<int> indices;
 
-    MemInstMappedShape() : mapped_shape(NONE), elem_size(0) {}
+    // INTERLEAVED: loads (stores) with a constant stride of group.size()
+    // elements from a common base. The group is accessed with a single wide
+    // load (store) of group.size() * num_lanes elements, emitted at the
+    // leader: the first load (last store) of the group. group[k] is the
+    // member accessing element k of each lane's chunk, or nullptr for gaps.
+    // group_offset is the byte offset of the leader pointer's scalar value
+    // from the start of the wide access.
+    std::vector<llvm::Instruction*> group;
+    unsigned group_index;
+    llvm::Instruction* group_leader;
+    int64_t group_offset;
+
+    // Loads: byte offsets from the address of lane 0 of the cache lines the
+    // gang that runs the prefetch distance later loads, see
+    // ShapesStep::calculatePrefetchOffsets
+    std::vector<int64_t> prefetch_offsets;
+
+    MemInstMappedShape()
+        : mapped_shape(NONE),
+          elem_size(0),
+          group_index(0),
+          group_leader(nullptr),
+          group_offset(0) {}
 
     std::string toString() {
         std::stringstream s;
@@ -67,6 +90,9 @@ struct MemInstMappedShape {
             case GATHER_SCATTER:
                 s << "GATHER_SCATTER";
                 break;
+            case INTERLEAVED:
+                s << "INTERLEAVED " << group_index << "/" << group.size();
+                break;
         }
         s << ", bytes " << std::to_string(elem_size);
         return s.str();
@@ -84,17 +110,31 @@ class Shape {
     // Constructors
 
     Shape(ShapeType type, z3::expr base, std::vector<z3::expr> indices)
-        : type(type), base(base), indices(indices), global_value(nullptr) {}
+        : type(type), base(base), indices(indices), global_value(nullptr) {
+        initOffsets();
+    }
 
-    static Shape Strided(z3::expr base, uint64_t stride, uint32_t num_lanes) {
+    // Indexed shape with numeral lane offsets, which are truncated to the
+    // width of the base
+    static Shape Concrete(z3::expr base, std::vector<uint64_t> offsets) {
         Shape s(INDEXED, base, {});
         unsigned width = base.get_sort().bv_size();
-        for (uint32_t i = 0; i < num_lanes; i++) {
-            s.indices.push_back(constantExpr(base.ctx(), i * stride, width));
+        for (uint64_t& offset : offsets) {
+            offset &= widthMask(width);
+            s.indices.push_back(constantExpr(base.ctx(), offset, width));
         }
+        s.offsets = offsets;
         return s;
     }
 
+    static Shape Strided(z3::expr base, uint64_t stride, uint32_t num_lanes) {
+        std::vector<uint64_t> offsets;
+        for (uint32_t i = 0; i < num_lanes; i++) {
+            offsets.push_back(i * stride);
+        }
+        return Concrete(base, offsets);
+    }
+
     static Shape Uniform(z3::expr base, uint32_t num_lanes) {
         return Strided(base, 0, num_lanes);
     }
@@ -167,12 +207,18 @@ class Shape {
             return false;
         }
         uint64_t val;
+        if (base.is_numeral_u64(val)) {
+            return true;
+        }
         bool success = base.simplify().is_numeral_u64(val);
         return success;
     }
 
     uint64_t getConstantBase() const {
         uint64_t val;
+        if (base.is_numeral_u64(val)) {
+            return val;
+        }
         bool success = base.simplify().is_numeral_u64(val);
         ASSERT(success,
                "Base is not constant: " << base.simplify().to_string());
@@ -183,12 +229,18 @@ class Shape {
 
     uint64_t getValueAtLane(unsigned i) const {
         uint64_t val;
+        if (hasConcreteIndices() && base.is_numeral_u64(val)) {
+            return (val + offsets[i]) & widthMask(base.get_sort().bv_size());
+        }
         bool success = (base + indices[i]).simplify().is_numeral_u64(val);
         assert(success);
         return val;
     }
 
     uint64_t getIndexAsInt(unsigned i) const {
+        if (hasConcreteIndices()) {
+            return offsets[i];
+        }
         uint64_t val;
         bool success = indices[i].simplify().is_numeral_u64(val);
         assert(success);
@@ -196,6 +248,9 @@ class Shape {
     }
 
     std::vector<uint64_t> getIndicesAsInts() const {
+        if (hasConcreteIndices()) {
+            return offsets;
+        }
         std::vector<uint64_t> v;
         for (unsigned i = 0; i < indices.size(); i++) {
             v.push_back(getIndexAsInt(i));
@@ -203,6 +258,16 @@ class Shape {
         return v;
     }
 
+    // True if all the lane indices are numerals; the shape rules can then
+    // compute the resulting indices without z3
+    bool hasConcreteIndices() const {
+        return type == INDEXED && offsets.size() == indices.size();
+    }
+
+    static uint64_t widthMask(unsigned width) {
+        return width >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+    }
+
     Shape eval(z3::model m) {
         if (type != INDEXED) {
             return *this;
@@ -238,6 +303,16 @@ class Shape {
             return false;
         }
 
+        if (hasConcreteIndices() && other.hasConcreteIndices()) {
+            if (offsets != other.offsets) {
+                return false;
+            }
+            if (z3::eq(base, other.base)) {
+                return true;
+            }
+            return (base == other.base).simplify().is_true();
+        }
+
         z3::expr_vector v(base.ctx());
         for (unsigned i = 0; i < indices.size(); i++) {
             v.push_back(indices[i] == other.indices[i]);
@@ -250,6 +325,29 @@ class Shape {
     std::string toString(bool symbolic_indices = false) const;
 
   protected:
+    // Numeral value of each of the indices, empty unless all of them are
+    // numerals
+    std::vector<uint64_t> offsets;
+
+    void initOffsets() {
+        if (type != INDEXED) {
+            return;
+        }
+        std::vector<uint64_t> v;
+        for (z3::expr& index : indices) {
+            uint64_t val;
+            if (!index.is_numeral_u64(val)) {
+                z3::expr simplified = index.simplify();
+                if (!simplified.is_numeral_u64(val)) {
+                    return;
+                }
+                index = simplified;
+            }
+            v.push_back(val);
+        }
+        offsets = v;
+    }
+
     bool getStride(uint64_t& stride) const {
         if (type != INDEXED) {
             return false;
@@ -11,8 +11,10 @@
 #include "shapes.h"
 
 #include <llvm/IR/Function.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/Passes/PassBuilder.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <numeric>
@@ -21,6 +23,8 @@
 #include <vector>
 
 #include "shape.h"
+#include "solver_cache.h"
+#include "time_report.h"
 #include "utils.h"
 #include "vectorize.h"
 
@@ -69,22 +73,35 @@ Shape ShapesStep::tryTransform(std::vector<T> transforms, Shape sa,
             }
             DEBUG_HIGH(llvm::errs().flush());
 
+            SolverCache::Key key = solver_cache.getKey(s, assumption);
+            z3::check_result r;
+            bool cached = solver_cache.lookup(key, r);
+
             s.push();
             s.add(!assumption);
 
-            auto t_before = std::chrono::high_resolution_clock::now();
-            z3::check_result r = s.check();
-            auto t_after = std::chrono::high_resolution_clock::now();
-            auto t_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
-                t_after - t_before);
-            if (verbosity_level >= 3 || t_diff.count() > 1000) {
-                PRINT_ALWAYS("Shape transform '" << t.name
-                                                 << "' assumption check took "
-                                                 << t_diff.count() << "ms");
-                PRINT_HIGH("Solver had " << vf_info.solver.assertions().size()
-                                         << " assertions");
-                for (auto i : vf_info.solver.assertions()) {
-                    PRINT_HIGH("  " << i.simplify().to_string());
+            if (!cached) {
+                auto t_before = std::chrono::high_resolution_clock::now();
+                {
+                    ModuleUnlockGuard unlock(vf_info.vm_info);
+                    r = s.check();
+                }
+                auto t_after = std::chrono::high_resolution_clock::now();
+                auto t_diff =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        t_after - t_before);
+                solver_cache.insert(key, r, t_diff.count());
+                TimeReport::addSolverQuery(t_diff.count());
+                if (verbosity_level >= 3 || t_diff.count() > 1000000) {
+                    PRINT_ALWAYS("Shape transform '"
+                                 << t.name << "' assumption check took "
+                                 << t_diff.count() / 1000 << "ms");
+                    PRINT_HIGH("Solver had "
+                               << vf_info.solver.assertions().size()
+                               << " assertions");
+                    for (auto i : vf_info.solver.assertions()) {
+                        PRINT_HIGH("  " << i.simplify().to_string());
+                    }
                 }
             }
 
@@ -94,7 +111,7 @@ Shape ShapesStep::tryTransform(std::vector<T> transforms, Shape sa,
                         "Found counterexample to assumption for shape "
                         "transform "
                         << t.name);
-                    if (verbosity_level >= 3) {
+                    if (verbosity_level >= 3 && !cached) {
                         z3::model m = s.get_model();
                         for (Shape i : {sa, other_shapes...}) {
                             PRINT_HIGH(i.toString());
@@ -211,6 +228,154 @@ Shape ShapesStep::transformKnownBases(
     return Shape::Indexed(base, indices);
 }
 
+/* Concrete counterparts of the z3 bit-vector operations used by the shape
+ * rules.  They follow the z3 semantics (e.g. for division by zero or for
+ * oversized shifts) so that they compute the same shapes as the z3 versions.
+ */
+static int64_t signExtend(uint64_t v, unsigned width) {
+    if (width >= 64) {
+        return (int64_t)v;
+    }
+    uint64_t sign = (uint64_t)1 << (width - 1);
+    return (int64_t)((v ^ sign) - sign);
+}
+
+static bool evalBinaryOp(Instruction::BinaryOps op, unsigned width, uint64_t a,
+                         uint64_t b, uint64_t& result) {
+    uint64_t mask = Shape::widthMask(width);
+    int64_t sa = signExtend(a, width);
+    int64_t sb = signExtend(b, width);
+    switch (op) {
+        case BinaryOperator::Add:
+            result = a + b;
+            break;
+        case BinaryOperator::And:
+            result = a & b;
+            break;
+        case BinaryOperator::AShr:
+            if (b >= width) {
+                result = sa < 0 ? mask : 0;
+            } else {
+                result = (uint64_t)(sa >> b);
+            }
+            break;
+        case BinaryOperator::LShr:
+            result = b >= width ? 0 : a >> b;
+            break;
+        case BinaryOperator::Mul:
+            result = a * b;
+            break;
+        case BinaryOperator::Or:
+            result = a | b;
+            break;
+        case BinaryOperator::SDiv:
+            if (b == 0) {
+                result = sa < 0 ? 1 : mask;
+            } else if (sb == -1) {
+                result = 0 - a;
+            } else {
+                result = (uint64_t)(sa / sb);
+            }
+            break;
+        case BinaryOperator::SRem:
+            if (b == 0) {
+                result = a;
+            } else if (sb == -1) {
+                result = 0;
+            } else {
+                result = (uint64_t)(sa % sb);
+            }
+            break;
+        case BinaryOperator::Shl:
+            result = b >= width ? 0 : a << b;
+            break;
+        case BinaryOperator::Sub:
+            result = a - b;
+            break;
+        case BinaryOperator::UDiv:
+            result = b == 0 ? mask : a / b;
+            break;
+        case BinaryOperator::URem:
+            result = b == 0 ? a : a % b;
+            break;
+        case BinaryOperator::Xor:
+            result = a ^ b;
+            break;
+        default:
+            return false;
+    }
+    result &= mask;
+    return true;
+}
+
+static bool evalCmp(CmpInst::Predicate pred, unsigned width, uint64_t a,
+                    uint64_t b, uint64_t& result) {
+    int64_t sa = signExtend(a, width);
+    int64_t sb = signExtend(b, width);
+    switch (pred) {
+        case CmpInst::Predicate::ICMP_NE:
+            result = a != b;
+            break;
+        case CmpInst::Predicate::ICMP_EQ:
+            result = a == b;
+            break;
+        case CmpInst::Predicate::ICMP_UGT:
+            result = a > b;
+            break;
+        case CmpInst::Predicate::ICMP_UGE:
+            result = a >= b;
+            break;
+        case CmpInst::Predicate::ICMP_ULT:
+            result = a < b;
+            break;
+        case CmpInst::Predicate::ICMP_ULE:
+            result = a <= b;
+            break;
+        case CmpInst::Predicate::ICMP_SLT:
+            result = sa < sb;
+            break;
+        case CmpInst::Predicate::ICMP_SLE:
+            result = sa <= sb;
+            break;
+        case CmpInst::Predicate::ICMP_SGT:
+            result = sa > sb;
+            break;
+        case CmpInst::Predicate::ICMP_SGE:
+            result = sa >= sb;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+/* Same as transformKnownBases, for shapes with constant bases and concrete
+ * indices: f is evaluated on the value of each lane without going through z3.
+ */
+Shape ShapesStep::transformConcreteValues(
+    std::function<uint64_t(const std::vector<uint64_t>&)> f, unsigned width,
+    std::vector<Shape> shapes) {
+    PRINT_HIGH("Transforming shape with known bases and concrete indices");
+    std::vector<uint64_t> bases;
+    for (Shape& s : shapes) {
+        bases.push_back(s.getConstantBase());
+    }
+    uint64_t base = f(bases) & Shape::widthMask(width);
+
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> values(shapes.size());
+    for (unsigned i = 0; i < shapes[0].indices.size(); i++) {
+        for (unsigned j = 0; j < shapes.size(); j++) {
+            unsigned shape_width = shapes[j].base.get_sort().bv_size();
+            values[j] = (bases[j] + shapes[j].getIndexAsInt(i)) &
+                        Shape::widthMask(shape_width);
+        }
+        offsets.push_back(f(values) - base);
+    }
+    return Shape::Concrete(Shape::constantExpr(vf_info.z3_ctx, base, width),
+                           offsets);
+}
+
 Shape ShapesStep::calculateShapeBinaryOp(BinaryOperator* binop) {
     Value* a = binop->getOperand(0);
     Value* b = binop->getOperand(1);
@@ -230,6 +395,20 @@ Shape ShapesStep::calculateShapeBinaryOp(BinaryOperator* binop) {
     std::vector<uint64_t> indices;
 
     /* If we know what the base values are at compile time, just do the math */
+    uint64_t unused;
+    unsigned width = sa.base.get_sort().bv_size();
+    if (sa.hasConstantBase() && sb.hasConstantBase() &&
+        sa.hasConcreteIndices() && sb.hasConcreteIndices() &&
+        evalBinaryOp(binop->getOpcode(), width, 0, 1, unused)) {
+        Instruction::BinaryOps op = binop->getOpcode();
+        return transformConcreteValues(
+            [op, width](const std::vector<uint64_t>& v) {
+                uint64_t result;
+                evalBinaryOp(op, width, v[0], v[1], result);
+                return result;
+            },
+            width, {sa, sb});
+    }
     if (sa.hasConstantBase() && sb.hasConstantBase()) {
         switch (binop->getOpcode()) {
             case BinaryOperator::Add:
@@ -316,6 +495,50 @@ Shape ShapesStep::calculateShapeBinaryOp(BinaryOperator* binop) {
         }
     }
 
+    /* With concrete indices, the transforms below can be applied directly as
+     * their assumptions do not need the solver */
+    if (sa.hasConcreteIndices() && sb.hasConcreteIndices()) {
+        std::vector<uint64_t> a = sa.getIndicesAsInts();
+        std::vector<uint64_t> b = sb.getIndicesAsInts();
+        bool b_uniform_constant =
+            sb.hasConstantBase() &&
+            std::all_of(b.begin(), b.end(), [](uint64_t i) { return i == 0; });
+        switch (binop->getOpcode()) {
+            case BinaryOperator::Add:
+                for (unsigned i = 0; i < a.size(); i++) {
+                    a[i] += b[i];
+                }
+                return Shape::Concrete(sa.base + sb.base, a);
+            case BinaryOperator::Sub:
+                for (unsigned i = 0; i < a.size(); i++) {
+                    a[i] -= b[i];
+                }
+                return Shape::Concrete(sa.base - sb.base, a);
+            case BinaryOperator::Mul:
+                // "mul1"
+                if (b_uniform_constant) {
+                    for (unsigned i = 0; i < a.size(); i++) {
+                        a[i] *= sb.getConstantBase();
+                    }
+                    return Shape::Concrete(sa.base * sb.base, a);
+                }
+                break;
+            case BinaryOperator::Shl:
+                // "shl"
+                if (b_uniform_constant &&
+                    signExtend(sb.getConstantBase(), width) > 0) {
+                    for (unsigned i = 0; i < a.size(); i++) {
+                        evalBinaryOp(BinaryOperator::Shl, width, a[i],
+                                     sb.getConstantBase(), a[i]);
+                    }
+                    return Shape::Concrete(z3::shl(sa.base, sb.base), a);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
     /* Try the transforms proven offline using z3 */
     switch (binop->getOpcode()) {
         case BinaryOperator::Add:
@@ -438,17 +661,41 @@ Shape ShapesStep::calculateShapeCall(CallInst* call) {
                 Shape::symbolicExpr(vf_info.z3_ctx, call->getName().str(),
                                     getValueSizeBits(call)),
                 num_lanes);
+        // the number of elements written is the same for all lanes
+        case FunctionResolver::PsimApiEnum::COMPRESS_STORE:
+        // votes are computed from the whole active mask
+        case FunctionResolver::PsimApiEnum::BALLOT_SYNC:
+        case FunctionResolver::PsimApiEnum::ANY_SYNC:
+        case FunctionResolver::PsimApiEnum::ALL_SYNC:
+        case FunctionResolver::PsimApiEnum::POPC_SYNC:
+        case FunctionResolver::PsimApiEnum::FIRST_ACTIVE_LANE:
+            return Shape::Uniform(
+                Shape::symbolicExpr(vf_info.z3_ctx, call->getName().str(),
+                                    getValueSizeBits(call)),
+                num_lanes);
+        // returns its pointer argument
+        case FunctionResolver::PsimApiEnum::NONTEMPORAL:
+            return value_cache.getShape(call->getArgOperand(0));
         // force UMULH to be varying for now
         case FunctionResolver::PsimApiEnum::UMULH:
         // *_SYNC is always varying since it is a collective
         case FunctionResolver::PsimApiEnum::SHFL_SYNC:
         case FunctionResolver::PsimApiEnum::ZIP_SYNC:
         case FunctionResolver::PsimApiEnum::UNZIP_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_ADD_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MIN_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MAX_SYNC:
+        case FunctionResolver::PsimApiEnum::EXPAND_LOAD:
             return Shape::Varying();
         // force ATOMICADD_LOCAL to be none for now
         case FunctionResolver::PsimApiEnum::ATOMICADD_LOCAL:
         case FunctionResolver::PsimApiEnum::GANG_SYNC:
         case FunctionResolver::PsimApiEnum::COLLECTIVE_ADD_ABS_DIFF:
+        case FunctionResolver::PsimApiEnum::REDUCE_ADD_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_MIN_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_MAX_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_AND_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_OR_SYNC:
             return Shape::None();
         case FunctionResolver::PsimApiEnum::PSIM_API_NONE:
             break;
@@ -496,6 +743,7 @@ Shape ShapesStep::calculateShapeGEP(GetElementPtrInst* gep) {
         assert(sv.indices.size() == shape.indices.size());
 
         // Dereference one level deeper into the GEP indexing
+        bool struct_field = false;
         PointerType* p_ty = dyn_cast<PointerType>(ty);
         StructType* s_ty = dyn_cast<StructType>(ty);
         if (p_ty) {
@@ -509,7 +757,19 @@ Shape ShapesStep::calculateShapeGEP(GetElementPtrInst* gep) {
             }
 
             // since the shape is uniform, it's safe to just use base here
-            ty = GetElementPtrInst::getTypeAtIndex(ty, sv.getConstantBase());
+            uint64_t field = sv.getConstantBase();
+            ty = GetElementPtrInst::getTypeAtIndex(ty, field);
+
+            // the fields are at the offsets of the struct layout, which
+            // aren't a multiple of the size of the field
+            uint64_t offset =
+                vf_info.data_layout.getStructLayout(s_ty)->getElementOffset(
+                    field);
+            sv = Shape::Uniform(
+                Shape::constantExpr(vf_info.z3_ctx, offset,
+                                    shape.base.get_sort().bv_size()),
+                num_lanes);
+            struct_field = true;
         } else {
             // for vector or array types, it doesn't matter which position in
             // the array we dereference to figure out the type
@@ -520,56 +780,130 @@ Shape ShapesStep::calculateShapeGEP(GetElementPtrInst* gep) {
         PRINT_HIGH("Indexed type is " << *ty);
 
         // Calculate the size of the type at the current level of dereferencing
-        int64_t s = vf_info.data_layout.getTypeAllocSize(ty);
+        int64_t s = struct_field
+                        ? 1
+                        : (int64_t)vf_info.data_layout.getTypeAllocSize(ty);
         z3::expr b = Shape::constantExpr(shape.base.ctx(), s,
                                          shape.base.get_sort().bv_size());
         PRINT_HIGH("Indexed type " << *ty << " has layout size " << s << " "
                                    << b.simplify().to_string());
 
         // Do the arithmetic to update the shape
-        for (unsigned i = 0; i < sv.indices.size(); i++) {
-            z3::expr idx = sv.indices[i];
-            if (b.get_sort().bv_size() > idx.get_sort().bv_size()) {
-                idx = z3::zext(
-                    idx, b.get_sort().bv_size() - idx.get_sort().bv_size());
-            }
-            shape.indices[i] = shape.indices[i] + idx * b;
-        }
         z3::expr base = sv.base;
         if (b.get_sort().bv_size() > base.get_sort().bv_size()) {
             base = z3::zext(base,
                             b.get_sort().bv_size() - base.get_sort().bv_size());
         }
-        shape.base = shape.base + base * b;
+        llvm::GlobalValue* gv = shape.global_value;
+        if (shape.hasConcreteIndices() && sv.hasConcreteIndices()) {
+            // the indices of sv are zero-extended, like in the z3 version
+            std::vector<uint64_t> offsets = shape.getIndicesAsInts();
+            for (unsigned i = 0; i < sv.indices.size(); i++) {
+                offsets[i] += sv.getIndexAsInt(i) * (uint64_t)s;
+            }
+            shape = Shape::Concrete(shape.base + base * b, offsets);
+        } else {
+            std::vector<z3::expr> indices = shape.indices;
+            for (unsigned i = 0; i < sv.indices.size(); i++) {
+                z3::expr idx = sv.indices[i];
+                if (b.get_sort().bv_size() > idx.get_sort().bv_size()) {
+                    idx = z3::zext(
+                        idx, b.get_sort().bv_size() - idx.get_sort().bv_size());
+                }
+                indices[i] = indices[i] + idx * b;
+            }
+            shape = Shape::Indexed(shape.base + base * b, indices);
+        }
+        shape.global_value = gv;
         PRINT_HIGH("New shape is " << shape.toString());
     }
     return shape;
 }
 
-/* Checks if array layout optimization could be applied for allocas */
-bool ShapesStep::analyzeUses(Instruction* inst) {
-    for (User* U : inst->users()) {
-        if (isa<LoadInst>(U))
-            continue;
-        else if (isa<BitCastInst>(U)) {
-            /* Recursively check users of bcast */
-            if (analyzeUses(cast<Instruction>(U))) continue;
-            return false;
-        } else if (isa<GetElementPtrInst>(U)) {
-            /* Disable opt for alloca->gep->gep->... for now. */
-            if (isa<GetElementPtrInst>(inst)) return false;
-            /* Recursively check users of gep */
-            if (analyzeUses(cast<Instruction>(U))) continue;
+/* The scalars that the layout optimization spreads across the lanes */
+static bool isLayoutOptScalar(Type* ty) {
+    return ty->isIntegerTy() || ty->isFloatingPointTy() || ty->isPointerTy();
+}
+
+/* True if a pointer to b points to the start of an object of type a, i.e. a
+ * pointer to a can be cast to a pointer to b in both layouts */
+static bool isLayoutOptPrefix(Type* a, Type* b) {
+    while (a != b) {
+        ArrayType* aa = dyn_cast<ArrayType>(a);
+        ArrayType* ab = dyn_cast<ArrayType>(b);
+        if (aa && ab && aa->getElementType() == ab->getElementType()) {
+            return true;
+        }
+        if (aa) {
+            a = aa->getElementType();
+        } else if (StructType* sa = dyn_cast<StructType>(a)) {
+            if (sa->getNumElements() == 0) {
+                return false;
+            }
+            a = sa->getElementType(0);
+        } else {
             return false;
-        } else if (CallInst* call = dyn_cast<CallInst>(U)) {
-            /* Conservatively return false for
-                all CallInsts except intrinsics */
-            if (call->getCalledFunction()->isIntrinsic()) continue;
+        }
+    }
+    return true;
+}
+
+/* True if the users of inst, a bitcast to i8*, don't depend on the layout:
+ * the lifetime markers and, for a bitcast of the alloca itself, memsets of
+ * all its size bytes */
+static bool hasOnlyWholeObjectUses(Instruction* inst, uint64_t size) {
+    for (User* U : inst->users()) {
+        IntrinsicInst* intrinsic = dyn_cast<IntrinsicInst>(U);
+        MemSetInst* memset = dyn_cast<MemSetInst>(U);
+        if (memset && memset->getDest() == inst && size != 0) {
+            ConstantInt* length = dyn_cast<ConstantInt>(memset->getLength());
+            if (length && length->getZExtValue() == size) {
+                continue;
+            }
+        }
+        if (!intrinsic || !intrinsic->isLifetimeStartOrEnd()) {
             return false;
+        }
+    }
+    return true;
+}
+
+/* The size of the alloca if inst is the alloca, 0 otherwise */
+static uint64_t getWholeObjectSize(Instruction* inst, const DataLayout& dl) {
+    AllocaInst* alloca = dyn_cast<AllocaInst>(inst);
+    if (!alloca) {
+        return 0;
+    }
+    Optional<TypeSize> size = alloca->getAllocationSizeInBits(dl);
+    return size ? size->getFixedSize() / 8 : 0;
+}
+
+/* Checks if array layout optimization could be applied for the alloca or the
+ * pointer derived from it inst: its scalars may only be loaded and stored,
+ * through GEPs and through bitcasts to a prefix of the pointed type, and
+ * other bitcasts may only feed the lifetime markers. No other code may
+ * depend on the layout of the alloca. */
+bool ShapesStep::analyzeUses(Instruction* inst) {
+    Type* ty = inst->getType()->getNonOpaquePointerElementType();
+    for (User* U : inst->users()) {
+        if (LoadInst* load = dyn_cast<LoadInst>(U)) {
+            if (!isLayoutOptScalar(load->getType())) return false;
         } else if (StoreInst* store = dyn_cast<StoreInst>(U)) {
             // pointers cannot escape
-            if (store->getValueOperand() != inst) continue;
-            return false;
+            if (store->getValueOperand() == inst) return false;
+            if (!isLayoutOptScalar(store->getValueOperand()->getType()))
+                return false;
+        } else if (GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(U)) {
+            if (gep->getPointerOperand() != inst) return false;
+            /* Recursively check users of gep */
+            if (!analyzeUses(gep)) return false;
+        } else if (BitCastInst* bcast = dyn_cast<BitCastInst>(U)) {
+            uint64_t size = getWholeObjectSize(inst, vf_info.data_layout);
+            if (hasOnlyWholeObjectUses(bcast, size)) continue;
+            Type* dst_ty = bcast->getDestTy()->getNonOpaquePointerElementType();
+            if (!isLayoutOptPrefix(ty, dst_ty)) return false;
+            /* Recursively check users of bcast */
+            if (!analyzeUses(bcast)) return false;
         } else {
             // Conservatively return false for other insts
             return false;
@@ -578,90 +912,147 @@ bool ShapesStep::analyzeUses(Instruction* inst) {
     return true;
 }
 
-/* Generates array layout optimized allocas and geps. */
-llvm::Instruction* ShapesStep::generateOptInsts(
-    AllocaInst* inst,
-    std::set<std::pair<Instruction*, Instruction*>>& toReplace) {
-    ArrayType* arr_ty = dyn_cast<ArrayType>(inst->getAllocatedType());
-    Type* new_array_type = ArrayType::get(arr_ty->getElementType(), num_lanes);
-    new_array_type = ArrayType::get(new_array_type, arr_ty->getNumElements());
-    Instruction* new_alloca =
-        new AllocaInst(new_array_type, 0, inst->getArraySize(),
-                       inst->getAlign(), inst->getName() + ".");
-    PRINT_HIGH("Array layout Opt -- New alloca is: " << *new_alloca);
-    toReplace.insert(std::make_pair(inst, new_alloca));
-
-    for (User* U : inst->users()) {
-        GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(U);
-        if (!gep) continue;
-        std::vector<Value*> idxlist;
-        for (Value* v : gep->indices()) {
-            idxlist.push_back(v);
+/* The type ty with its scalars replaced by arrays of num_lanes elements, one
+ * per lane: element-major, lane-minor arrays, and structs of arrays */
+Type* ShapesStep::getLayoutOptType(Type* ty) {
+    if (StructType* sty = dyn_cast<StructType>(ty)) {
+        std::vector<Type*> fields;
+        for (Type* field : sty->elements()) {
+            fields.push_back(getLayoutOptType(field));
         }
-        Function* lane_num = vf_info.mod->getFunction("psim_get_lane_num");
-        Instruction* get_lane_id =
-            CallInst::Create(lane_num, gep->getName() + ".");
-        idxlist.push_back(get_lane_id);
-        Instruction* new_gep = GetElementPtrInst::Create(
-            new_array_type, new_alloca, idxlist, gep->getName() + ".");
-        toReplace.insert(std::make_pair(gep, new_gep));
-    }
-    return new_alloca;
+        return StructType::get(vf_info.ctx, fields, sty->isPacked());
+    }
+    if (ArrayType* aty = dyn_cast<ArrayType>(ty)) {
+        return ArrayType::get(getLayoutOptType(aty->getElementType()),
+                              aty->getNumElements());
+    }
+    return ArrayType::get(ty, num_lanes);
 }
 
-/* Replaces allocas and geps with array layout optimized versions. */
-void ShapesStep::insertOptInsts(
-    std::set<std::pair<Instruction*, Instruction*>>& toReplace) {
-    for (auto& i : toReplace) {
-        PRINT_HIGH("Array layout Opt -- Replacing: " << *i.first
-                                                     << " With: " << *i.second);
-        if (GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(i.second)) {
-            // We know that the last operand of the new gep should be getlanenum
-            // call
-            Value* val = gep->getOperand(gep->getNumOperands() - 1);
-            CallInst* call = dyn_cast<CallInst>(val);
-            if (!call || vf_info.vm_info.function_resolver.getPsimApiEnum(
-                             call->getCalledFunction()) !=
-                             FunctionResolver::PsimApiEnum::GET_LANE_NUM)
-                FATAL(
-                    "Array layout opt -- Last index of gep not a getlanenum "
-                    "call"
-                    << *val);
-
-            call->insertBefore(i.first);
-            vf_info.instruction_order.insert(
-                std::find(std::begin(vf_info.instruction_order),
-                          std::end(vf_info.instruction_order), i.first),
-                call);
+/* Rewrites the users of inst, a pointer derived from the alloca, to use
+ * new_ptr, the same pointer in the optimized layout. GEPs and bitcasts are
+ * mirrored with the same indices in the optimized layout, and loads and
+ * stores access the element of their lane. The replaced instructions are
+ * added to dead, parents first. */
+void ShapesStep::generateOptInsts(Instruction* inst, Instruction* new_ptr,
+                                  FunctionCallee lane_num,
+                                  std::vector<Instruction*>& dead) {
+    auto& order = vf_info.instruction_order;
+    auto insertInOrder = [&](Instruction* new_inst, Instruction* before) {
+        order.insert(std::find(order.begin(), order.end(), before), new_inst);
+    };
+
+    dead.push_back(inst);
+    for (User* U : make_early_inc_range(inst->users())) {
+        Instruction* user = cast<Instruction>(U);
+        std::string name = user->getName().str() + ".";
+        if (GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(user)) {
+            std::vector<Value*> idxlist(gep->idx_begin(), gep->idx_end());
+            Instruction* new_gep = GetElementPtrInst::Create(
+                getLayoutOptType(gep->getSourceElementType()), new_ptr,
+                idxlist, name);
+            new_gep->insertAfter(gep);
+            insertInOrder(new_gep, gep);
+            PRINT_HIGH("Array layout Opt -- Replacing: " << *gep << " With: "
+                                                         << *new_gep);
+            generateOptInsts(gep, new_gep, lane_num, dead);
+        } else if (BitCastInst* bcast = dyn_cast<BitCastInst>(user)) {
+            Type* dst_ty = bcast->getDestTy();
+            uint64_t size = getWholeObjectSize(inst, vf_info.data_layout);
+            bool whole_object = hasOnlyWholeObjectUses(bcast, size);
+            if (!whole_object) {
+                dst_ty = PointerType::get(
+                    getLayoutOptType(dst_ty->getNonOpaquePointerElementType()),
+                    dst_ty->getPointerAddressSpace());
+            }
+            Instruction* new_bcast = new BitCastInst(new_ptr, dst_ty, name);
+            new_bcast->insertAfter(bcast);
+            insertInOrder(new_bcast, bcast);
+            if (whole_object) {
+                // the object in the optimized layout has no tail padding per
+                // lane, so it may be smaller than num_lanes objects
+                uint64_t new_size = vf_info.data_layout.getTypeAllocSize(
+                    new_ptr->getType()->getNonOpaquePointerElementType());
+                for (User* BU : bcast->users()) {
+                    IntrinsicInst* intrinsic = cast<IntrinsicInst>(BU);
+                    unsigned arg = isa<MemSetInst>(intrinsic) ? 2 : 0;
+                    ConstantInt* length =
+                        cast<ConstantInt>(intrinsic->getArgOperand(arg));
+                    if (!length->isMinusOne()) {
+                        intrinsic->setArgOperand(
+                            arg, ConstantInt::get(length->getType(), new_size));
+                    }
+                }
+                bcast->replaceAllUsesWith(new_bcast);
+                dead.push_back(bcast);
+            } else {
+                generateOptInsts(bcast, new_bcast, lane_num, dead);
+            }
+        } else {
+            // load or store of a scalar: select the element of the lane
+            Type* lanes_ty =
+                new_ptr->getType()->getNonOpaquePointerElementType();
+            Instruction* lane = CallInst::Create(lane_num, name);
+            lane->insertBefore(user);
+            insertInOrder(lane, user);
+            Instruction* elem = GetElementPtrInst::Create(
+                lanes_ty, new_ptr,
+                {ConstantInt::get(Type::getInt64Ty(vf_info.ctx), 0), lane},
+                name);
+            elem->insertBefore(user);
+            insertInOrder(elem, user);
+            user->replaceUsesOfWith(inst, elem);
+            PRINT_HIGH("Array layout Opt -- Accessing lane element: " << *user);
         }
-        i.second->insertAfter(i.first);
-        i.first->replaceAllUsesWith(i.second);
-        std::replace(vf_info.instruction_order.begin(),
-                     vf_info.instruction_order.end(), i.first, i.second);
-        i.first->eraseFromParent();
     }
 }
 
-/* Checks for and applies array layout optimization for allocas. */
+/* Checks for and applies array layout optimization for allocas: private
+ * arrays and structs are laid out with the element of each lane next to the
+ * element of the next lane, so that uniform indices give packed accesses
+ * instead of gathers and scatters with the stride of the whole alloca. */
 void ShapesStep::arrayLayoutOpt() {
-    std::set<std::pair<Instruction*, Instruction*>> toReplace;
+    std::vector<AllocaInst*> allocas;
     for (Instruction* I : vf_info.instruction_order) {
         AllocaInst* alloca = dyn_cast<AllocaInst>(I);
         if (!alloca) continue;
-        ArrayType* ty = dyn_cast<ArrayType>(alloca->getAllocatedType());
-        if (!ty) continue;
-        if (ty->getElementType()->isStructTy()) continue;
+        Type* ty = alloca->getAllocatedType();
+        if (!ty->isArrayTy() && !ty->isStructTy()) continue;
         if (!analyzeUses(I)) continue;
+        allocas.push_back(alloca);
+    }
+
+    // the region may not call psim_get_lane_num() itself
+    FunctionCallee lane_num = vf_info.mod->getOrInsertFunction(
+        "psim_get_lane_num", Type::getInt32Ty(vf_info.ctx));
+
+    for (AllocaInst* alloca : allocas) {
         PRINT_HIGH("Array layout Opt -- Optimizing alloca " << *alloca);
-        Instruction* new_alloca = generateOptInsts(alloca, toReplace);
+        Instruction* new_alloca = new AllocaInst(
+            getLayoutOptType(alloca->getAllocatedType()), 0,
+            alloca->getArraySize(), alloca->getAlign(),
+            alloca->getName() + ".");
+        new_alloca->insertAfter(alloca);
+        std::replace(vf_info.instruction_order.begin(),
+                     vf_info.instruction_order.end(),
+                     static_cast<Instruction*>(alloca), new_alloca);
+        PRINT_HIGH("Array layout Opt -- New alloca is: " << *new_alloca);
+
+        std::vector<Instruction*> dead;
+        generateOptInsts(alloca, new_alloca, lane_num, dead);
+        for (auto it = dead.rbegin(); it != dead.rend(); it++) {
+            auto& order = vf_info.instruction_order;
+            order.erase(std::remove(order.begin(), order.end(), *it),
+                        order.end());
+            (*it)->eraseFromParent();
+        }
+
         z3::expr base =
             Shape::symbolicExpr(vf_info.z3_ctx, new_alloca->getName().str(),
                                 getValueSizeBits(new_alloca));
         value_cache.setShape(new_alloca, Shape::Uniform(base, num_lanes));
         value_cache.setArrayLayoutOpt(new_alloca);
     }
-
-    insertOptInsts(toReplace);
 }
 
 Shape ShapesStep::calculateShapeCmp(ICmpInst* cmp) {
@@ -681,6 +1072,20 @@ Shape ShapesStep::calculateShapeCmp(ICmpInst* cmp) {
 
     CmpInst::Predicate pred = cmp->getPredicate();
 
+    uint64_t unused;
+    unsigned width = sa.base.get_sort().bv_size();
+    if (sa.hasConstantBase() && sb.hasConstantBase() &&
+        sa.hasConcreteIndices() && sb.hasConcreteIndices() &&
+        evalCmp(pred, width, 0, 0, unused)) {
+        return transformConcreteValues(
+            [pred, width](const std::vector<uint64_t>& v) {
+                uint64_t result;
+                evalCmp(pred, width, v[0], v[1], result);
+                return result;
+            },
+            1, {sa, sb});
+    }
+
     if (sa.hasConstantBase() && sb.hasConstantBase()) {
         switch (pred) {
             case CmpInst::Predicate::ICMP_NE:
@@ -771,6 +1176,13 @@ Shape ShapesStep::calculateShapeCmp(ICmpInst* cmp) {
 }
 
 Shape ShapesStep::calculateShapeLoad(LoadInst* load) {
+    if (isVersionAssumption(load)) {
+        PRINT_HIGH("Load is assumed to be 1 by the versioned clone");
+        return Shape::Uniform(
+            Shape::constantExpr(vf_info.z3_ctx, 1, getValueSizeBits(load)),
+            num_lanes);
+    }
+
     Shape shape = value_cache.getShape(load->getPointerOperand());
     PRINT_HIGH("Pointer operand has shape " << shape.toString());
     if (shape.isUniform() && !load->getType()->isVectorTy()) {
@@ -873,6 +1285,15 @@ Shape ShapesStep::calculateShapePHI(PHINode* phi) {
     PRINT_HIGH("pulled shape a " << sa.toString());
     PRINT_HIGH("pulled shape b " << sb.toString());
     PRINT_HIGH("pulled shape c " << sc.toString());
+    if (sc.hasConstantBase() && sa.hasConstantBase() && sb.hasConstantBase() &&
+        sc.hasConcreteIndices() && sa.hasConcreteIndices() &&
+        sb.hasConcreteIndices()) {
+        return transformConcreteValues(
+            [is_inverted](const std::vector<uint64_t>& v) {
+                return (v[0] == 1) != is_inverted ? v[2] : v[1];
+            },
+            sa.base.get_sort().bv_size(), {sc, sa, sb});
+    }
     if (sc.hasConstantBase() && sa.hasConstantBase() && sb.hasConstantBase()) {
         if (is_inverted) {
             return transformKnownBases(
@@ -948,7 +1369,16 @@ Shape ShapesStep::calculateShapeSelect(SelectInst* select) {
         return Shape::Varying();
     }
 
-    if (sa.hasConstantBase() && sb.hasConstantBase() && sc.hasConstantBase()) {
+    if (sa.hasConstantBase() && sb.hasConstantBase() && sc.hasConstantBase() &&
+        sa.hasConcreteIndices() && sb.hasConcreteIndices() &&
+        sc.hasConcreteIndices()) {
+        return transformConcreteValues(
+            [](const std::vector<uint64_t>& v) {
+                return v[0] == 1 ? v[1] : v[2];
+            },
+            sa.base.get_sort().bv_size(), {sc, sa, sb});
+    } else if (sa.hasConstantBase() && sb.hasConstantBase() &&
+               sc.hasConstantBase()) {
         return transformKnownBases(
             [](z3::expr c, z3::expr a, z3::expr b) {
                 return z3::ite(c == 1, a, b);
@@ -1000,6 +1430,11 @@ Shape ShapesStep::calculateShapeTrunc(TruncInst* trunc) {
     assert(sa.isIndexed());
 
     unsigned width = getValueSizeBits(trunc);
+    if (sa.hasConcreteIndices()) {
+        // "trunc" has no assumptions
+        return Shape::Concrete(sa.base.extract(width - 1, 0),
+                               sa.getIndicesAsInts());
+    }
     return tryTransform<UnaryShapeTransform>({known_transforms.trunc(width)},
                                              sa);
 }
@@ -1015,7 +1450,15 @@ Shape ShapesStep::calculateShapeExt(Instruction* ext, bool is_signed) {
     assert(sa.isIndexed());
 
     unsigned width = getValueSizeBits(ext);
-    if (sa.hasConstantBase()) {
+    if (sa.hasConstantBase() && sa.hasConcreteIndices()) {
+        unsigned src_width = sa.base.get_sort().bv_size();
+        return transformConcreteValues(
+            [is_signed, src_width](const std::vector<uint64_t>& v) {
+                return is_signed ? (uint64_t)signExtend(v[0], src_width)
+                                 : v[0];
+            },
+            width, {sa});
+    } else if (sa.hasConstantBase()) {
         unsigned ext_bits = width - sa.base.get_sort().bv_size();
         PRINT_HIGH("Adding " << ext_bits << " bits");
         if (is_signed) {
@@ -1204,8 +1647,406 @@ void ShapesStep::calulateFinalMemInstMappedShapes() {
         } else {
             ret.mapped_shape = MemInstMappedShape::GATHER_SCATTER;
         }
+        if (load) {
+            calculatePrefetchOffsets(load, ret);
+        }
         value_cache.setMemInstMappedShape(I, ret);
     }
+
+    groupInterleavedMemInsts();
+}
+
+/* A load whose address advances by a constant number of bytes from one gang
+ * to the next is prefetched for the gang that runs prefetch distance gangs
+ * later, with one prefetch per cache line the gang accesses. Strided gathers,
+ * which the hardware prefetchers usually don't follow, get one prefetch per
+ * lane, unless their lanes access more than max_gather_lines lines.
+ */
+void ShapesStep::calculatePrefetchOffsets(LoadInst* load,
+                                          MemInstMappedShape& ret) {
+    const int64_t line_size = 64;
+    const size_t max_gather_lines = 16;
+    unsigned distance = vf_info.getPrefetchDistance();
+    if (distance == 0 || ret.mapped_shape == MemInstMappedShape::UNIFORM ||
+        ret.mapped_shape == MemInstMappedShape::GLOBAL_VALUE) {
+        return;
+    }
+
+    Shape shape = value_cache.getShape(load->getPointerOperand());
+    if (!shape.hasConcreteIndices() || shape.base.get_sort().bv_size() != 64) {
+        return;
+    }
+
+    // The next gang has the next gang_num, and its threads the next
+    // num_lanes thread_nums
+    z3::expr thread_num = Shape::symbolicExpr(vf_info.z3_ctx, "thread_num", 64);
+    z3::expr gang_num = Shape::symbolicExpr(vf_info.z3_ctx, "gang_num", 64);
+    z3::expr_vector from(vf_info.z3_ctx);
+    z3::expr_vector to(vf_info.z3_ctx);
+    from.push_back(thread_num);
+    to.push_back(thread_num +
+                 Shape::constantExpr(vf_info.z3_ctx, num_lanes, 64));
+    from.push_back(gang_num);
+    to.push_back(gang_num + Shape::constantExpr(vf_info.z3_ctx, 1, 64));
+    z3::expr base = shape.base;
+    z3::expr advance = (base.substitute(from, to) - base).simplify();
+    int64_t gang_advance;
+    if (!advance.is_numeral_i64(gang_advance) || gang_advance == 0) {
+        return;
+    }
+
+    std::vector<uint64_t> indices = shape.getIndicesAsInts();
+    std::vector<int64_t> offsets;
+    for (uint64_t index : indices) {
+        offsets.push_back((int64_t)index - (int64_t)indices[0]);
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    int64_t ahead = gang_advance * (int64_t)distance;
+    int64_t last = 0;
+    for (int64_t offset : offsets) {
+        if (ret.prefetch_offsets.empty() || offset - last >= line_size) {
+            ret.prefetch_offsets.push_back(ahead + offset);
+            last = offset;
+        }
+    }
+    // The end of a contiguous range may be on one more line
+    if (last != offsets.back()) {
+        TypeSize size = vf_info.data_layout.getTypeStoreSize(load->getType());
+        ret.prefetch_offsets.push_back(ahead + offsets.back() +
+                                       (int64_t)size.getFixedSize() - 1);
+    }
+    // the prefetches of wide gathers with a large stride would cost as many
+    // instructions as the gather itself
+    if (ret.mapped_shape == MemInstMappedShape::GATHER_SCATTER &&
+        ret.prefetch_offsets.size() > max_gather_lines) {
+        PRINT_HIGH("Not prefetching " << ret.prefetch_offsets.size()
+                                      << " lines for " << *load);
+        ret.prefetch_offsets.clear();
+        return;
+    }
+    PRINT_HIGH("Prefetching " << ret.prefetch_offsets.size() << " lines "
+                              << ahead << " bytes ahead for " << *load);
+}
+
+// Returns the number of elements between consecutive lanes if inst is a load
+// or store with a constant stride of 2 to 4 elements, or 0 otherwise
+unsigned ShapesStep::getInterleaveFactor(Instruction* inst) {
+    LoadInst* load = dyn_cast<LoadInst>(inst);
+    StoreInst* store = dyn_cast<StoreInst>(inst);
+    if ((!load && !store) || global_opts.scalable_size != 0) {
+        return 0;
+    }
+    if ((load && !load->isSimple()) || (store && !store->isSimple())) {
+        return 0;
+    }
+
+    MemInstMappedShape minst_shape = value_cache.getMemInstMappedShape(inst);
+    if (minst_shape.mapped_shape != MemInstMappedShape::PACKED_SHUFFLE &&
+        minst_shape.mapped_shape != MemInstMappedShape::GATHER_SCATTER) {
+        return 0;
+    }
+
+    Shape shape = value_cache.getShape(getLoadStorePointerOperand(inst));
+    if (!shape.hasConcreteIndices() || shape.indices.size() < 2 ||
+        !shape.isStrided()) {
+        return 0;
+    }
+
+    int64_t stride = (int64_t)shape.getStride();
+    int64_t esize = (int64_t)minst_shape.elem_size;
+    if (stride <= 0 || stride % esize != 0 || stride / esize < 2 ||
+        stride / esize > 4) {
+        return 0;
+    }
+    return (unsigned)(stride / esize);
+}
+
+// Returns true and sets "distance" to the distance in bytes between the
+// addresses accessed by lane 0 of a and b, if it is a constant
+bool ShapesStep::getConstantDistance(Instruction* a, Instruction* b,
+                                     int64_t& distance) {
+    Shape sa = value_cache.getShape(getLoadStorePointerOperand(a));
+    Shape sb = value_cache.getShape(getLoadStorePointerOperand(b));
+    if (sa.base.get_sort().bv_size() != sb.base.get_sort().bv_size()) {
+        return false;
+    }
+    z3::expr diff = (sb.base - sa.base).simplify();
+    int64_t base_distance;
+    if (!diff.is_numeral_i64(base_distance)) {
+        return false;
+    }
+    distance = base_distance + (int64_t)sb.getIndexAsInt(0) -
+               (int64_t)sa.getIndexAsInt(0);
+    return true;
+}
+
+/* Groups the loads (stores) of a basic block which access the consecutive
+ * elements of an interleaved array, e.g. the b, g and r channels of a BGR
+ * image, so that they are emitted as a single wide packed access followed
+ * (preceded) by shufflevectors instead of one shuffled access or one
+ * gather/scatter per member.
+ *
+ * Loads are grouped with the loads that follow them as long as no
+ * instruction in between may write to memory. Stores are only grouped with
+ * the stores that immediately follow them in memory order, since the whole
+ * group is stored at its last member.
+ */
+void ShapesStep::groupInterleavedMemInsts() {
+    struct Group {
+        std::vector<Instruction*> members;
+        std::vector<int64_t> distances;
+        unsigned factor;
+        Type* type;
+    };
+    std::vector<Group> groups;
+    std::vector<Group> open_loads;
+    Group open_stores;
+    BasicBlock* BB = nullptr;
+
+    auto closeGroup = [&](Group& group) {
+        if (group.members.size() > 1) {
+            groups.push_back(group);
+        }
+        group.members.clear();
+        group.distances.clear();
+    };
+    auto closeLoads = [&]() {
+        for (Group& group : open_loads) {
+            closeGroup(group);
+        }
+        open_loads.clear();
+    };
+
+    // Adds inst to group if it fits in a chunk of "factor" elements and its
+    // slot is still free
+    auto tryAdd = [&](Group& group, Instruction* inst, unsigned factor,
+                      Type* ty) {
+        if (group.members.empty()) {
+            group.members.push_back(inst);
+            group.distances.push_back(0);
+            group.factor = factor;
+            group.type = ty;
+            return true;
+        }
+        int64_t distance;
+        if (group.factor != factor || group.type != ty ||
+            !getConstantDistance(group.members[0], inst, distance)) {
+            return false;
+        }
+        int64_t esize =
+            (int64_t)vf_info.data_layout.getTypeAllocSize(ty).getFixedSize();
+        if (distance % esize != 0) {
+            return false;
+        }
+        int64_t min = std::min(distance, *std::min_element(
+                                             group.distances.begin(),
+                                             group.distances.end()));
+        int64_t max = std::max(distance, *std::max_element(
+                                             group.distances.begin(),
+                                             group.distances.end()));
+        if ((max - min) / esize >= (int64_t)factor ||
+            std::find(group.distances.begin(), group.distances.end(),
+                      distance) != group.distances.end()) {
+            return false;
+        }
+        group.members.push_back(inst);
+        group.distances.push_back(distance);
+        return true;
+    };
+
+    for (Instruction* I : vf_info.instruction_order) {
+        if (I->getParent() != BB) {
+            closeLoads();
+            closeGroup(open_stores);
+            BB = I->getParent();
+        }
+
+        unsigned factor = getInterleaveFactor(I);
+        LoadInst* load = dyn_cast<LoadInst>(I);
+        StoreInst* store = dyn_cast<StoreInst>(I);
+
+        if (factor && load) {
+            bool added = false;
+            for (Group& group : open_loads) {
+                if (tryAdd(group, I, factor, load->getType())) {
+                    added = true;
+                    break;
+                }
+            }
+            if (!added) {
+                open_loads.push_back({});
+                tryAdd(open_loads.back(), I, factor, load->getType());
+            }
+            closeGroup(open_stores);
+            continue;
+        }
+
+        if (factor && store) {
+            Type* ty = store->getValueOperand()->getType();
+            closeLoads();
+            if (!tryAdd(open_stores, I, factor, ty)) {
+                closeGroup(open_stores);
+                tryAdd(open_stores, I, factor, ty);
+            }
+            continue;
+        }
+
+        if (I->mayReadOrWriteMemory()) {
+            closeGroup(open_stores);
+            if (I->mayWriteToMemory()) {
+                closeLoads();
+            }
+        }
+    }
+    closeLoads();
+    closeGroup(open_stores);
+
+    for (Group& group : groups) {
+        Instruction* first = group.members[0];
+        bool is_load = isa<LoadInst>(first);
+        Instruction* leader = is_load ? first : group.members.back();
+        int64_t esize =
+            (int64_t)vf_info.data_layout.getTypeAllocSize(group.type)
+                .getFixedSize();
+        int64_t min = *std::min_element(group.distances.begin(),
+                                        group.distances.end());
+
+        std::vector<Instruction*> slots(group.factor, nullptr);
+        int64_t leader_distance = 0;
+        for (unsigned i = 0; i < group.members.size(); i++) {
+            slots[(group.distances[i] - min) / esize] = group.members[i];
+            if (group.members[i] == leader) {
+                leader_distance = group.distances[i];
+            }
+        }
+
+        // The scalar value of a pointer is the base of its shape, lane 0
+        // accesses base + index 0
+        Shape leader_shape =
+            value_cache.getShape(getLoadStorePointerOperand(leader));
+        int64_t group_offset =
+            leader_distance - min - (int64_t)leader_shape.getIndexAsInt(0);
+
+        PRINT_MID("Interleaved " << (is_load ? "load" : "store")
+                                 << " group of " << group.members.size()
+                                 << " members, stride " << group.factor
+                                 << ", leader " << *leader);
+        for (unsigned k = 0; k < slots.size(); k++) {
+            if (!slots[k]) {
+                continue;
+            }
+            MemInstMappedShape ret =
+                value_cache.getMemInstMappedShape(slots[k]);
+            ret.mapped_shape = MemInstMappedShape::INTERLEAVED;
+            ret.indices.clear();
+            ret.group = slots;
+            ret.group_index = k;
+            ret.group_leader = leader;
+            ret.group_offset = group_offset;
+            value_cache.setMemInstMappedShape(slots[k], ret);
+        }
+    }
+}
+
+bool ShapesStep::getVersionedValue(Value* v,
+                                   VectorizedFunctionInfo::VersionedValue& vv) {
+    if (!v->getType()->isIntegerTy()) {
+        return false;
+    }
+
+    Argument* arg = dyn_cast<Argument>(v);
+    if (arg) {
+        if (arg->getArgNo() >= vf_info.vfabi.parameters.size() ||
+            vf_info.vfabi.parameters[arg->getArgNo()].is_varying ||
+            vf_info.vfabi.parameters[arg->getArgNo()].stride != 0) {
+            return false;
+        }
+        vv = {arg->getArgNo(), nullptr};
+        return true;
+    }
+
+    // A load from a uniform argument in the entry block, before any store, can
+    // be repeated at the entry of the function to check the assumption
+    LoadInst* load = dyn_cast<LoadInst>(v);
+    if (!load || !load->isSimple() ||
+        load->getParent() != &vf_info.VF->getEntryBlock()) {
+        return false;
+    }
+    arg = dyn_cast<Argument>(load->getPointerOperand());
+    if (!arg || arg->getArgNo() >= vf_info.vfabi.parameters.size() ||
+        vf_info.vfabi.parameters[arg->getArgNo()].is_varying) {
+        return false;
+    }
+    for (Instruction& I : vf_info.VF->getEntryBlock()) {
+        if (&I == load) {
+            break;
+        }
+        if (I.mayWriteToMemory()) {
+            return false;
+        }
+    }
+    vv = {arg->getArgNo(), load->getType()};
+    return true;
+}
+
+bool ShapesStep::isVersionAssumption(Value* v) {
+    VectorizedFunctionInfo::VersionedValue vv;
+    if (vf_info.version_assumptions.empty() || !getVersionedValue(v, vv)) {
+        return false;
+    }
+    auto& assumptions = vf_info.version_assumptions;
+    return std::find(assumptions.begin(), assumptions.end(), vv) !=
+           assumptions.end();
+}
+
+/* Look for the uniform values with an unknown value which feed the address of
+ * a gather or scatter. Strides that are only known at runtime are typically
+ * 1, so ModuleVectorizer::versionFunction() creates a clone of the function
+ * in which they are assumed to be 1, selected by a runtime check.
+ */
+void ShapesStep::findVersionCandidates() {
+    if (!global_opts.versioning || !vf_info.version_assumptions.empty()) {
+        return;
+    }
+
+    for (Instruction* I : vf_info.instruction_order) {
+        MemInstMappedShape minst_shape = value_cache.getMemInstMappedShape(I);
+        if (minst_shape.mapped_shape != MemInstMappedShape::GATHER_SCATTER) {
+            continue;
+        }
+
+        std::vector<Value*> work_list = {getLoadStorePointerOperand(I)};
+        std::unordered_set<Value*> visited;
+        while (!work_list.empty()) {
+            Value* v = work_list.back();
+            work_list.pop_back();
+            if (!visited.insert(v).second) {
+                continue;
+            }
+
+            VectorizedFunctionInfo::VersionedValue vv;
+            Shape shape = value_cache.getShape(v);
+            if (shape.isUniform() && !shape.hasConstantBase() &&
+                getVersionedValue(v, vv)) {
+                auto& candidates = vf_info.version_candidates;
+                if (std::find(candidates.begin(), candidates.end(), vv) ==
+                    candidates.end()) {
+                    PRINT_MID("Versioning candidate " << *v << " for " << *I);
+                    candidates.push_back(vv);
+                }
+                continue;
+            }
+
+            Instruction* inst = dyn_cast<Instruction>(v);
+            if (inst && (isa<GetElementPtrInst>(inst) ||
+                         isa<BinaryOperator>(inst) || isa<CastInst>(inst))) {
+                for (Value* op : inst->operands()) {
+                    work_list.push_back(op);
+                }
+            }
+        }
+    }
 }
 
 void ShapesStep::printShapes() {
@@ -1241,6 +2082,13 @@ void ShapesStep::calculate() {
         auto arg = vf_info.VF->getArg(i);
         if (p.is_varying) {
             value_cache.setShape(vf_info.VF->getArg(i), Shape::Varying());
+        } else if (isVersionAssumption(arg)) {
+            PRINT_HIGH("Argument " << *arg
+                                   << " is assumed to be 1 by the versioned "
+                                      "clone");
+            z3::expr base = Shape::constantExpr(vf_info.z3_ctx, 1,
+                                                getValueSizeBits(arg));
+            value_cache.setShape(arg, Shape::Uniform(base, num_lanes));
         } else {
             unsigned width = getValueSizeBits(arg);
             std::string name = value_cache.getConstName(arg);
@@ -1281,6 +2129,7 @@ void ShapesStep::calculate() {
     }
 
     calulateFinalMemInstMappedShapes();
+    findVersionCandidates();
 
     DEBUG_MID(printShapes());
 }
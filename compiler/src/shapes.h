@@ -41,6 +41,9 @@ class ShapesStep {
     Shape transformKnownBases(
         std::function<z3::expr(z3::expr, z3::expr, z3::expr)> f, Shape sa,
         Shape sb, Shape sc);
+    Shape transformConcreteValues(
+        std::function<uint64_t(const std::vector<uint64_t>&)> f,
+        unsigned width, std::vector<Shape> shapes);
 
     void calculateShape(std::unordered_set<llvm::Instruction*>& work_queue,
                         llvm::Instruction* I, bool allow_overwrite = false);
@@ -57,13 +60,22 @@ class ShapesStep {
 
     void arrayLayoutOpt();
     bool analyzeUses(llvm::Instruction* inst);
-    llvm::Instruction* generateOptInsts(
-        llvm::AllocaInst* inst,
-        std::set<std::pair<llvm::Instruction*, llvm::Instruction*>>& toReplace);
-    void insertOptInsts(
-        std::set<std::pair<llvm::Instruction*, llvm::Instruction*>>& toReplace);
+    llvm::Type* getLayoutOptType(llvm::Type* ty);
+    void generateOptInsts(llvm::Instruction* inst, llvm::Instruction* new_ptr,
+                          llvm::FunctionCallee lane_num,
+                          std::vector<llvm::Instruction*>& dead);
 
     void calulateFinalMemInstMappedShapes();
+    unsigned getInterleaveFactor(llvm::Instruction* inst);
+    bool getConstantDistance(llvm::Instruction* a, llvm::Instruction* b,
+                             int64_t& distance);
+    void groupInterleavedMemInsts();
+    void calculatePrefetchOffsets(llvm::LoadInst* load,
+                                  MemInstMappedShape& ret);
+    bool getVersionedValue(llvm::Value* v,
+                           VectorizedFunctionInfo::VersionedValue& vv);
+    bool isVersionAssumption(llvm::Value* v);
+    void findVersionCandidates();
     void printShapes();
 
     unsigned getValueSizeBits(llvm::Value* v);
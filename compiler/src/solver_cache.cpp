@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#include "solver_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+#include <unistd.h>
+
+#include "utils.h"
+
+namespace ps {
+
+unsigned solver_cache_verbosity_level;
+[[maybe_unused]] static unsigned& verbosity_level =
+    solver_cache_verbosity_level;
+
+SolverCache solver_cache;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The walks below visit the solver assertions for every query, so they use
+// the C API: the C++ wrappers reference count and check for errors on every
+// access to a node.
+
+static void appendSort(Z3_context ctx, Z3_sort sort, std::string& key) {
+    if (Z3_get_sort_kind(ctx, sort) == Z3_BV_SORT) {
+        key += "bv" + std::to_string(Z3_get_bv_sort_size(ctx, sort));
+    } else {
+        key += Z3_sort_to_string(ctx, sort);
+    }
+}
+
+// Appends e to key in prefix form, with the free variables numbered in order
+// of first appearance and the subterms already appended referenced by their
+// number. This walks the DAG of e once, unlike substitute() and to_string().
+static void appendExpr(Z3_context ctx, Z3_ast e, std::string& key,
+                       std::unordered_map<Z3_ast, unsigned>& variables,
+                       std::unordered_map<Z3_ast, unsigned>& subterms) {
+    auto it = subterms.find(e);
+    if (it != subterms.end()) {
+        key += "#" + std::to_string(it->second) + " ";
+        return;
+    }
+    Z3_ast_kind kind = Z3_get_ast_kind(ctx, e);
+    if (kind == Z3_NUMERAL_AST) {
+        key += Z3_get_numeral_string(ctx, e);
+        key += ":";
+        appendSort(ctx, Z3_get_sort(ctx, e), key);
+    } else if (kind != Z3_APP_AST) {
+        key += Z3_ast_to_string(ctx, e);
+    } else {
+        Z3_app app = Z3_to_app(ctx, e);
+        Z3_func_decl decl = Z3_get_app_decl(ctx, app);
+        unsigned num_args = Z3_get_app_num_args(ctx, app);
+        if (num_args == 0 &&
+            Z3_get_decl_kind(ctx, decl) == Z3_OP_UNINTERPRETED) {
+            unsigned index =
+                variables.emplace(e, variables.size()).first->second;
+            key += "v" + std::to_string(index) + ":";
+            appendSort(ctx, Z3_get_sort(ctx, e), key);
+        } else {
+            key += "(";
+            key += Z3_get_symbol_string(ctx, Z3_get_decl_name(ctx, decl));
+            // e.g. the bounds of extract
+            for (unsigned i = 0; i < Z3_get_decl_num_parameters(ctx, decl);
+                 i++) {
+                key += "_";
+                if (Z3_get_decl_parameter_kind(ctx, decl, i) ==
+                    Z3_PARAMETER_INT) {
+                    key += std::to_string(
+                        Z3_get_decl_int_parameter(ctx, decl, i));
+                } else {
+                    key += Z3_func_decl_to_string(ctx, decl);
+                }
+            }
+            key += " ";
+            for (unsigned i = 0; i < num_args; i++) {
+                appendExpr(ctx, Z3_get_app_arg(ctx, app, i), key, variables,
+                           subterms);
+            }
+            key += ")";
+        }
+    }
+    key += " ";
+    subterms.emplace(e, subterms.size());
+}
+
+// Union-find of the free variables (uninterpreted constants) that appear in
+// the same formula
+static Z3_ast findRoot(std::unordered_map<Z3_ast, Z3_ast>& parents,
+                       Z3_ast v) {
+    Z3_ast& parent = parents.emplace(v, v).first->second;
+    if (parent != v) {
+        parent = findRoot(parents, parent);
+    }
+    return parent;
+}
+
+// Merges the sets of the variables of e and returns the root of the merged
+// set, or nullptr if e has no variable. roots memoizes the subterms, so that
+// the nodes shared by several formulas are visited once.
+static Z3_ast unionVariables(Z3_context ctx, Z3_ast e,
+                             std::unordered_map<Z3_ast, Z3_ast>& roots,
+                             std::unordered_map<Z3_ast, Z3_ast>& parents) {
+    auto it = roots.find(e);
+    if (it != roots.end()) {
+        return it->second ? findRoot(parents, it->second) : nullptr;
+    }
+    Z3_ast root = nullptr;
+    if (Z3_get_ast_kind(ctx, e) == Z3_APP_AST) {
+        Z3_app app = Z3_to_app(ctx, e);
+        unsigned num_args = Z3_get_app_num_args(ctx, app);
+        if (num_args == 0 && Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, app)) ==
+                                 Z3_OP_UNINTERPRETED) {
+            root = findRoot(parents, e);
+        }
+        for (unsigned i = 0; i < num_args; i++) {
+            Z3_ast arg_root = unionVariables(ctx, Z3_get_app_arg(ctx, app, i),
+                                             roots, parents);
+            if (!root) {
+                root = arg_root;
+            } else if (arg_root && arg_root != root) {
+                parents[arg_root] = root;
+            }
+        }
+    }
+    roots[e] = root;
+    return root;
+}
+
+SolverCache::Key SolverCache::getKey(z3::solver& solver,
+                                     const z3::expr& assumption) {
+    auto t_before = std::chrono::steady_clock::now();
+    Z3_context ctx = assumption.ctx();
+    z3::expr_vector assertions = solver.assertions();
+
+    // Keep the assertions that share a variable with the assumption, directly
+    // or through other relevant assertions
+    std::vector<Z3_ast> formulas = {assumption};
+    for (unsigned i = 0; i < assertions.size(); i++) {
+        formulas.push_back(assertions[i]);
+    }
+    std::unordered_map<Z3_ast, Z3_ast> roots;
+    std::unordered_map<Z3_ast, Z3_ast> parents;
+    std::vector<Z3_ast> formula_variables;
+    for (Z3_ast f : formulas) {
+        formula_variables.push_back(unionVariables(ctx, f, roots, parents));
+    }
+    Z3_ast relevant_root = formula_variables[0]
+                               ? findRoot(parents, formula_variables[0])
+                               : nullptr;
+
+    // The key is the whole query rather than a hash of it, so that two
+    // queries never share an entry
+    Key key;
+    std::unordered_map<Z3_ast, unsigned> renamed;
+    std::unordered_map<Z3_ast, unsigned> subterms;
+    for (size_t i = 0; i < formulas.size(); i++) {
+        if (i != 0 &&
+            (!formula_variables[i] ||
+             findRoot(parents, formula_variables[i]) != relevant_root)) {
+            continue;
+        }
+        appendExpr(ctx, formulas[i], key, renamed, subterms);
+        key += "; ";
+    }
+
+    auto t_after = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> guard(mutex);
+    key_time_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                       t_after - t_before)
+                       .count();
+    return key;
+}
+
+bool SolverCache::lookup(const Key& key, z3::check_result& result) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        num_misses++;
+        return false;
+    }
+    num_hits++;
+    saved_time_us += it->second.solve_time_us;
+    result = it->second.result;
+    PRINT_HIGH("Solver cache hit for key " << key);
+    return true;
+}
+
+void SolverCache::insert(const Key& key, z3::check_result result,
+                         uint64_t solve_time_us) {
+    // unknown results depend on resource limits, don't cache them
+    if (result == z3::unknown) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    this->solve_time_us += solve_time_us;
+    entries[key] = {result, solve_time_us};
+}
+
+// First line of the cache files. Files of another version, e.g. with the
+// former hashed keys, are ignored.
+static const char* cache_file_header = "psv-solver-cache 2";
+
+bool SolverCache::readFile(const std::string& file_name) {
+    std::ifstream file(file_name);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != cache_file_header) {
+        PRINT_LOW("Ignoring solver cache " << file_name
+                                           << " of another version");
+        return false;
+    }
+    while (std::getline(file, line)) {
+        // "<s|u> <solve time> <key>", the key may contain spaces
+        std::istringstream ss(line);
+        char result;
+        uint64_t time_us;
+        if (!(ss >> result >> time_us) || ss.get() != ' ' ||
+            (result != 's' && result != 'u')) {
+            WARNING("Ignoring malformed solver cache entry in " << file_name);
+            continue;
+        }
+        Key key = line.substr((size_t)ss.tellg());
+        entries.insert(
+            {key, {result == 's' ? z3::sat : z3::unsat, time_us}});
+    }
+    return true;
+}
+
+void SolverCache::load(const std::string& file_name) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (readFile(file_name)) {
+        PRINT_LOW("Loaded " << entries.size() << " solver cache entries from "
+                            << file_name);
+    }
+}
+
+void SolverCache::save(const std::string& file_name) {
+    std::lock_guard<std::mutex> guard(mutex);
+    readFile(file_name);
+
+    // write to a temporary file and rename it, so that readers never see a
+    // partially written cache
+    std::string tmp_name = file_name + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(tmp_name);
+        if (!file) {
+            WARNING("Could not write solver cache " << tmp_name);
+            return;
+        }
+        file << cache_file_header << "\n";
+        for (auto& it : entries) {
+            file << (it.second.result == z3::sat ? 's' : 'u') << " "
+                 << it.second.solve_time_us << " " << it.first << "\n";
+        }
+    }
+    if (std::rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+        WARNING("Could not write solver cache " << file_name);
+        std::remove(tmp_name.c_str());
+        return;
+    }
+    PRINT_LOW("Saved " << entries.size() << " solver cache entries to "
+                       << file_name);
+}
+
+void SolverCache::printStats() {
+    std::lock_guard<std::mutex> guard(mutex);
+    uint64_t num_queries = num_hits + num_misses;
+    llvm::errs() << "Solver cache: " << num_queries << " queries, " << num_hits
+                 << " hits ("
+                 << (num_queries ? 100 * num_hits / num_queries : 0)
+                 << "%), solver time " << solve_time_us / 1000
+                 << "ms, saved " << saved_time_us / 1000
+                 << "ms, key time " << key_time_us / 1000 << "ms\n";
+}
+
+}  // namespace ps
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#pragma once
+
+#include <z3++.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ps {
+
+extern unsigned solver_cache_verbosity_level;
+
+/* Memoizes the result of the shape legality checks done in
+ * ShapesStep::tryTransform. A query is "is !assumption satisfiable under the
+ * solver assertions?". Its key is the text of the assumption and of the
+ * assertions that (transitively) share a free variable with it, after the free
+ * variables have been renamed in order of appearance. Identical queries issued
+ * by the head/body/tail clones of a region, or by different kernels, thus map
+ * to the same key, and different queries never do.
+ */
+class SolverCache {
+  public:
+    typedef std::string Key;
+
+    Key getKey(z3::solver& solver, const z3::expr& assumption);
+    bool lookup(const Key& key, z3::check_result& result);
+    void insert(const Key& key, z3::check_result result,
+                uint64_t solve_time_us);
+
+    // Persistent cache, merged with the file contents when saving so that
+    // concurrent compilations sharing the file don't lose entries
+    void load(const std::string& file_name);
+    void save(const std::string& file_name);
+
+    void printStats();
+
+  private:
+    struct Entry {
+        z3::check_result result;
+        uint64_t solve_time_us;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<Key, Entry> entries;
+
+    uint64_t num_hits = 0;
+    uint64_t num_misses = 0;
+    uint64_t solve_time_us = 0;
+    uint64_t saved_time_us = 0;
+    uint64_t key_time_us = 0;
+
+    bool readFile(const std::string& file_name);
+};
+
+extern SolverCache solver_cache;
+
+}  // namespace ps
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#include "time_report.h"
+
+#include <llvm/Support/Format.h>
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace ps {
+
+TimeReport time_report;
+
+// Functions are vectorized by one thread at a time (psv -j), so the queries
+// issued by a step are those issued by its thread while it runs
+static thread_local TimeReport::Times thread_times;
+
+void TimeReport::addSolverQuery(uint64_t solver_us) {
+    thread_times.solver_queries++;
+    thread_times.solver_us += solver_us;
+}
+
+TimeReport::Times TimeReport::getThreadTimes() { return thread_times; }
+
+void TimeReport::add(const std::string& function, const std::string& step,
+                     const Times& times) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = function_index.find(function);
+    if (it == function_index.end()) {
+        it = function_index.insert({function, functions.size()}).first;
+        functions.push_back({function, {}});
+    }
+    auto& steps = functions[it->second].steps;
+    for (auto& s : steps) {
+        if (s.first == step) {
+            s.second.add(times);
+            return;
+        }
+    }
+    steps.push_back({step, times});
+}
+
+static double ms(uint64_t us) { return us / 1000.0; }
+
+static std::string jsonString(const std::string& s) {
+    std::string ret = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+        }
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+void TimeReport::print(raw_ostream& os, uint64_t total_wall_us) {
+    std::lock_guard<std::mutex> guard(mutex);
+    // functions vectorized concurrently are added in any order
+    std::sort(functions.begin(), functions.end(),
+              [](const FunctionTimes& a, const FunctionTimes& b) {
+                  return a.name < b.name;
+              });
+    for (size_t i = 0; i < functions.size(); i++) {
+        function_index[functions[i].name] = i;
+    }
+    if (json) {
+        printJson(os, total_wall_us);
+    } else {
+        printText(os, total_wall_us);
+    }
+}
+
+// Sums the times of each step over all the functions, in order of appearance
+std::vector<std::pair<std::string, TimeReport::Times>>
+TimeReport::getStepTotals() {
+    std::vector<std::pair<std::string, Times>> totals;
+    for (FunctionTimes& f : functions) {
+        for (auto& s : f.steps) {
+            auto it = std::find_if(
+                totals.begin(), totals.end(),
+                [&](std::pair<std::string, Times>& t) {
+                    return t.first == s.first;
+                });
+            if (it == totals.end()) {
+                totals.push_back(s);
+            } else {
+                it->second.add(s.second);
+            }
+        }
+    }
+    return totals;
+}
+
+void TimeReport::printText(raw_ostream& os, uint64_t total_wall_us) {
+    auto printLine = [&](const std::string& name, const Times& t) {
+        os << "    " << left_justify(name, 40)
+           << format("%12.3f %12llu %12.3f\n", ms(t.wall_us),
+                     (unsigned long long)t.solver_queries, ms(t.solver_us));
+    };
+
+    os << "===------------------------------------------------------------"
+          "----------------===\n";
+    os << "    psv time report\n";
+    os << "===------------------------------------------------------------"
+          "----------------===\n";
+    os << "    " << left_justify("step", 40)
+       << right_justify("wall (ms)", 12) << " "
+       << right_justify("z3 queries", 12) << " "
+       << right_justify("z3 (ms)", 12) << "\n";
+
+    for (FunctionTimes& f : functions) {
+        os << f.name << "\n";
+        Times total;
+        for (auto& s : f.steps) {
+            printLine(s.first, s.second);
+            total.add(s.second);
+        }
+        printLine("total", total);
+    }
+
+    os << "All functions\n";
+    Times total;
+    for (auto& s : getStepTotals()) {
+        printLine(s.first, s.second);
+        total.add(s.second);
+    }
+    printLine("total", total);
+    os << "psv wall time: " << format("%.3f", ms(total_wall_us)) << " ms\n";
+}
+
+void TimeReport::printJson(raw_ostream& os, uint64_t total_wall_us) {
+    auto printTimes = [&](const Times& t) {
+        os << "{\"wall_ms\": " << format("%.3f", ms(t.wall_us))
+           << ", \"z3_queries\": " << t.solver_queries
+           << ", \"z3_ms\": " << format("%.3f", ms(t.solver_us)) << "}";
+    };
+    auto printSteps = [&](const std::vector<std::pair<std::string, Times>>&
+                              steps) {
+        os << "{";
+        for (size_t i = 0; i < steps.size(); i++) {
+            os << (i ? ", " : "") << jsonString(steps[i].first) << ": ";
+            printTimes(steps[i].second);
+        }
+        os << "}";
+    };
+
+    os << "{\"functions\": {";
+    for (size_t i = 0; i < functions.size(); i++) {
+        os << (i ? ",\n    " : "\n    ") << jsonString(functions[i].name)
+           << ": ";
+        printSteps(functions[i].steps);
+    }
+    os << "},\n \"totals\": ";
+    printSteps(getStepTotals());
+    os << ",\n \"wall_ms\": " << format("%.3f", ms(total_wall_us)) << "}\n";
+}
+
+TimeReportScope::TimeReportScope(const std::string& function, const char* step)
+    : step(step) {
+    if (!time_report.enabled) {
+        return;
+    }
+    this->function = function;
+    start = std::chrono::steady_clock::now();
+    start_times = TimeReport::getThreadTimes();
+}
+
+TimeReportScope::~TimeReportScope() {
+    if (!time_report.enabled) {
+        return;
+    }
+    TimeReport::Times end_times = TimeReport::getThreadTimes();
+    TimeReport::Times times;
+    times.wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    times.solver_queries =
+        end_times.solver_queries - start_times.solver_queries;
+    times.solver_us = end_times.solver_us - start_times.solver_us;
+    time_report.add(function, step, times);
+}
+
+}  // namespace ps
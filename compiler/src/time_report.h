@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ps {
+
+/* Compile time of each step of psv (--time-report), per vectorized function
+ * and aggregated over the translation unit. Module-level steps are recorded
+ * under the function name "<module>".
+ */
+class TimeReport {
+  public:
+    bool enabled = false;
+    bool json = false;
+
+    struct Times {
+        uint64_t wall_us = 0;
+        uint64_t solver_queries = 0;
+        uint64_t solver_us = 0;
+
+        void add(const Times& other) {
+            wall_us += other.wall_us;
+            solver_queries += other.solver_queries;
+            solver_us += other.solver_us;
+        }
+    };
+
+    void add(const std::string& function, const std::string& step,
+             const Times& times);
+    void print(llvm::raw_ostream& os, uint64_t total_wall_us);
+
+    // Counts a z3 query issued by the calling thread
+    static void addSolverQuery(uint64_t solver_us);
+    static Times getThreadTimes();
+
+  private:
+    struct FunctionTimes {
+        std::string name;
+        std::vector<std::pair<std::string, Times>> steps;
+    };
+
+    std::mutex mutex;
+    std::vector<FunctionTimes> functions;
+    std::unordered_map<std::string, size_t> function_index;
+
+    std::vector<std::pair<std::string, Times>> getStepTotals();
+    void printText(llvm::raw_ostream& os, uint64_t total_wall_us);
+    void printJson(llvm::raw_ostream& os, uint64_t total_wall_us);
+};
+
+extern TimeReport time_report;
+
+// Records the time spent until the end of the scope
+class TimeReportScope {
+  public:
+    TimeReportScope(const std::string& function, const char* step);
+    ~TimeReportScope();
+
+  private:
+    std::string function;
+    const char* step;
+    std::chrono::steady_clock::time_point start;
+    TimeReport::Times start_times;
+};
+
+}  // namespace ps
@@ -28,9 +28,11 @@
 #include <unordered_map>
 #include <vector>
 
+#include "module.h"
 #include "resolver.h"
 #include "utils.h"
 #include "vectorize.h"
+#include "vmath.h"
 
 using namespace llvm;
 
@@ -78,6 +80,7 @@ Value* TransformStep::transformMemInst(Instruction* inst) {
     MemInstMappedShape minst_shape = value_cache.getMemInstMappedShape(inst);
 
     PRINT_HIGH("Transforming " << *inst << ": " << minst_shape.toString());
+    emitPrefetches(inst, minst_shape);
     switch (minst_shape.mapped_shape) {
         case MemInstMappedShape::UNIFORM: {
             return transformInstructionWithoutVectorizing(inst);
@@ -98,12 +101,90 @@ Value* TransformStep::transformMemInst(Instruction* inst) {
             size_t esize = minst_shape.elem_size;
             return vectorizeMemInst(inst, false, {}, esize);
         } break;
+        case MemInstMappedShape::INTERLEAVED: {
+            return vectorizeInterleavedMemInst(inst, minst_shape);
+        } break;
         default:
             FATAL("unreachable");
             break;
     }
 }
 
+/* Prefetches the cache lines that a later gang loads, see
+ * ShapesStep::calculatePrefetchOffsets. The members of an interleaved group
+ * access the same lines, only the leader prefetches them.
+ */
+void TransformStep::emitPrefetches(Instruction* inst,
+                                   MemInstMappedShape& minst_shape) {
+    if (minst_shape.prefetch_offsets.empty() ||
+        (minst_shape.mapped_shape == MemInstMappedShape::INTERLEAVED &&
+         minst_shape.group_leader != inst)) {
+        return;
+    }
+
+    IRBuilder<> builder(inst);
+    std::string name = inst->getName().str() + ".prefetch.";
+    Type* i8 = builder.getInt8Ty();
+    Type* i8_ptr = builder.getInt8PtrTy();
+    Function* prefetch = Intrinsic::getDeclaration(
+        vf_info.mod, Intrinsic::prefetch, {i8_ptr});
+
+    Value* ptr = value_cache.getScalarValue(getLoadStorePointerOperand(inst));
+    ptr = builder.CreatePointerCast(ptr, i8_ptr, name);
+    for (int64_t offset : minst_shape.prefetch_offsets) {
+        Value* p = builder.CreateGEP(i8, ptr, builder.getInt64(offset), name);
+        // read, high temporal locality, data cache
+        builder.CreateCall(prefetch,
+                           {p, builder.getInt32(0), builder.getInt32(3),
+                            builder.getInt32(1)});
+    }
+}
+
+/* True if all the lanes are active whenever BB executes. Branches on uniform
+ * conditions are not vectorized, so a block whose active mask is uniform only
+ * executes when the mask is true. The mask of the entry block of an unmasked
+ * function (e.g., the body gangs of a region) is the constant true, and stays
+ * uniform in the blocks reached through uniform control flow.
+ */
+bool TransformStep::hasFullActiveMask(BasicBlock* BB) {
+    Value* mask = vf_info.bb_masks[BB].active_mask;
+    if (!mask || !value_cache.getShape(mask).isUniform()) {
+        return false;
+    }
+    PRINT_HIGH("BasicBlock " << BB->getName() << " has a full active mask");
+    return true;
+}
+
+/* Adds !nontemporal to the stores through ptr or through pointers derived
+ * from it. The scalar stores are not transformed yet, vectorizeMemInst keeps
+ * the metadata on the packed stores of full gangs.
+ */
+void TransformStep::markNontemporalStores(Value* ptr) {
+    MDNode* md = MDNode::get(
+        ptr->getContext(),
+        ConstantAsMetadata::get(
+            ConstantInt::get(Type::getInt32Ty(ptr->getContext()), 1)));
+    std::vector<Value*> worklist = {ptr};
+    std::unordered_set<Value*> visited = {ptr};
+    while (!worklist.empty()) {
+        Value* v = worklist.back();
+        worklist.pop_back();
+        for (User* user : v->users()) {
+            if (StoreInst* st = dyn_cast<StoreInst>(user)) {
+                if (st->getPointerOperand() == v) {
+                    PRINT_HIGH("Non-temporal store " << *st);
+                    st->setMetadata(LLVMContext::MD_nontemporal, md);
+                }
+            } else if (isa<GetElementPtrInst>(user) || isa<BitCastInst>(user) ||
+                       isa<PHINode>(user) || isa<SelectInst>(user)) {
+                if (visited.insert(user).second) {
+                    worklist.push_back(user);
+                }
+            }
+        }
+    }
+}
+
 void TransformStep::rebaseMemPackedIndices(std::vector<int>& indices,
                                            int& min_index, unsigned& factor) {
     factor = 1;
@@ -202,7 +283,11 @@ Value* TransformStep::vectorizeMemInst(Instruction* inst, bool packed,
     Type* ty = st ? val->getType() : ld->getType();
     Type* sty = ty->getScalarType();
 
-    Value* mask = generateMaskForMemInst(inst, indices, factor);
+    // Shuffled accesses also need to disable the positions which no lane
+    // accesses, so they keep their mask
+    bool full_mask = indices.empty() && hasFullActiveMask(inst->getParent());
+    Value* mask =
+        full_mask ? nullptr : generateMaskForMemInst(inst, indices, factor);
     Value* ret;
 
     Type* vty = VectorType::get(sty, getElementCount(num_lanes * factor));
@@ -212,11 +297,12 @@ Value* TransformStep::vectorizeMemInst(Instruction* inst, bool packed,
         // Add min index to the base pointer
         if (min_index != 0) {
             assert(esize != 0);
-            Value* offset = builder.getInt64(min_index * esize);
-            Value* ptr64 =
-                builder.CreatePtrToInt(ptr, builder.getInt64Ty(), name);
-            ptr64 = builder.CreateAdd(ptr64, offset, name);
-            ptr = builder.CreateIntToPtr(ptr64, ptr->getType(), name);
+            Type* i8_ptr = builder.getInt8PtrTy(
+                ptr->getType()->getPointerAddressSpace());
+            Value* p = builder.CreatePointerCast(ptr, i8_ptr, name);
+            p = builder.CreateGEP(builder.getInt8Ty(), p,
+                                  builder.getInt64(min_index * esize), name);
+            ptr = builder.CreatePointerCast(p, ptr->getType(), name);
         }
 
         // shuffle value only for stores
@@ -234,8 +320,15 @@ Value* TransformStep::vectorizeMemInst(Instruction* inst, bool packed,
         Type* pty = PointerType::get(vty, 0);
         Value* p = builder.CreateBitCast(ptr, pty, name);
 
-        if (st) {
+        if (st && full_mask) {
+            // stores of whole gangs stream to memory, masked stores can't
+            StoreInst* vst = builder.CreateAlignedStore(val, p, align);
+            vst->copyMetadata(*st, {LLVMContext::MD_nontemporal});
+            ret = vst;
+        } else if (st) {
             ret = builder.CreateMaskedStore(val, p, align, mask);
+        } else if (full_mask) {
+            ret = builder.CreateAlignedLoad(vty, p, align, name);
         } else {
             ret = builder.CreateMaskedLoad(vty, p, align, mask, nullptr, name);
         }
@@ -248,6 +341,7 @@ Value* TransformStep::vectorizeMemInst(Instruction* inst, bool packed,
         Value* ptrs = value_cache.getVectorValue(ptr);
         assert(esize != 0);
         printWarning(inst, "scatter/gather emitted");
+        // a null mask enables all the lanes
         if (st) {
             vf_info.diagnostics.scatters[esize].push_back(valueString(inst));
             ret = builder.CreateMaskedScatter(val, ptrs, align, mask);
@@ -261,6 +355,109 @@ Value* TransformStep::vectorizeMemInst(Instruction* inst, bool packed,
     return ret;
 }
 
+/* Loads of an interleaved group are extracted with a shufflevector from a
+ * single wide load emitted at the first load of the group. Stores of a group
+ * are merged into a single wide store emitted at the last store of the group.
+ * Element k of lane i is at position i * factor + k of the wide vector.
+ */
+Value* TransformStep::vectorizeInterleavedMemInst(
+    Instruction* inst, MemInstMappedShape& minst_shape) {
+    LoadInst* ld = dyn_cast<LoadInst>(inst);
+    StoreInst* st = dyn_cast<StoreInst>(inst);
+    unsigned factor = minst_shape.group.size();
+    Instruction* leader = minst_shape.group_leader;
+
+    IRBuilder<> builder(inst->getParent());
+    builder.SetInsertPoint(inst->getNextNode());
+    std::string name = inst->getName().str() + ".";
+
+    value_cache.setToBeDeleted(inst);
+
+    if (st && inst != leader) {
+        // emitted with the last store of the group
+        return nullptr;
+    }
+
+    if (inst == leader) {
+        Value* ptr =
+            value_cache.getScalarValue(getLoadStorePointerOperand(inst));
+        Type* sty = ld ? ld->getType() : st->getValueOperand()->getType();
+        auto align = ld ? ld->getAlign() : st->getAlign();
+        align = commonAlignment(align, minst_shape.elem_size);
+
+        // Move the pointer to the first element of lane 0's chunk
+        if (minst_shape.group_offset != 0) {
+            Type* i8_ptr = builder.getInt8PtrTy(
+                ptr->getType()->getPointerAddressSpace());
+            Value* p = builder.CreatePointerCast(ptr, i8_ptr, name);
+            p = builder.CreateGEP(builder.getInt8Ty(), p,
+                                  builder.getInt64(-minst_shape.group_offset),
+                                  name);
+            ptr = builder.CreatePointerCast(p, ptr->getType(), name);
+        }
+
+        // Lane i enables the elements of its chunk that belong to a member
+        bool has_gaps = std::find(minst_shape.group.begin(),
+                                  minst_shape.group.end(),
+                                  nullptr) != minst_shape.group.end();
+        bool full_mask = !has_gaps && hasFullActiveMask(inst->getParent());
+        Value* mask = nullptr;
+        if (!full_mask) {
+            Value* bb_mask = value_cache.getVectorValue(
+                vf_info.bb_masks[inst->getParent()].active_mask);
+            mask = builder.CreateShuffleVector(
+                bb_mask, createReplicatedMask(factor, num_lanes), name);
+        }
+        if (has_gaps) {
+            std::vector<Constant*> slot_mask;
+            for (unsigned i = 0; i < num_lanes * factor; i++) {
+                slot_mask.push_back(minst_shape.group[i % factor]
+                                        ? builder.getTrue()
+                                        : builder.getFalse());
+            }
+            Value* slots = value_cache.genConstVect(
+                ConstantVector::get(slot_mask), builder);
+            mask = builder.CreateAnd(mask, slots, name);
+        }
+
+        Type* vty =
+            VectorType::get(sty, getElementCount(num_lanes * factor));
+        Value* p = builder.CreateBitCast(ptr, PointerType::get(vty, 0), name);
+
+        if (st) {
+            SmallVector<Value*> values;
+            for (Instruction* member : minst_shape.group) {
+                Value* v =
+                    member ? value_cache.getVectorValue(
+                                 cast<StoreInst>(member)->getValueOperand())
+                           : PoisonValue::get(VectorType::get(
+                                 sty, getElementCount(num_lanes)));
+                values.push_back(v);
+            }
+            Value* val = concatenateVectors(builder, values);
+            val = builder.CreateShuffleVector(
+                val, createInterleaveMask(num_lanes, factor), name);
+            if (full_mask) {
+                return builder.CreateAlignedStore(val, p, align);
+            }
+            return builder.CreateMaskedStore(val, p, align, mask);
+        }
+
+        if (full_mask) {
+            interleaved_loads[leader] =
+                builder.CreateAlignedLoad(vty, p, align, name);
+        } else {
+            interleaved_loads[leader] =
+                builder.CreateMaskedLoad(vty, p, align, mask, nullptr, name);
+        }
+    }
+
+    assert(interleaved_loads.count(leader));
+    return builder.CreateShuffleVector(
+        interleaved_loads[leader],
+        createStrideMask(minst_shape.group_index, factor, num_lanes), name);
+}
+
 Value* TransformStep::transformBranch(BranchInst* inst) {
     // For conditional branches, vectorize the condition
     if (inst->isConditional()) {
@@ -429,20 +626,19 @@ Value* TransformStep::transformCall(CallInst* inst) {
         return psim_api;
     }
 
+    // check if vector math, before the intrinsics since the transcendental
+    // ones would be scalarized by LLVM
+    Value* vmath = transformCallVmath(inst);
+    if (vmath) {
+        return vmath;
+    }
+
     // check if instrinsic
     Value* instrinsic = transformCallIntrinsic(inst);
     if (instrinsic) {
         return instrinsic;
     }
 
-#ifdef SLEEF_ENABLE
-    // check if vector math
-    Value* vmath = transformCallVmath(inst);
-    if (vmath) {
-        return vmath;
-    }
-#endif
-
     // check if this call is to another vectorized function
     Value* vfunc = transformCallVectFunction(inst);
     if (vfunc) {
@@ -467,6 +663,293 @@ Value* TransformStep::transformCall(CallInst* inst) {
     return vectorizeUniformCall(inst);
 }
 
+TransformStep::ReduceOp TransformStep::getReduceOp(
+    FunctionResolver::PsimApiEnum api_enum) {
+    switch (api_enum) {
+        case FunctionResolver::PsimApiEnum::REDUCE_ADD_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_ADD_SYNC:
+            return REDUCE_ADD;
+        case FunctionResolver::PsimApiEnum::REDUCE_MIN_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MIN_SYNC:
+            return REDUCE_MIN;
+        case FunctionResolver::PsimApiEnum::REDUCE_MAX_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MAX_SYNC:
+            return REDUCE_MAX;
+        case FunctionResolver::PsimApiEnum::REDUCE_AND_SYNC:
+            return REDUCE_AND;
+        case FunctionResolver::PsimApiEnum::REDUCE_OR_SYNC:
+            return REDUCE_OR;
+        default:
+            FATAL("Not a reduction API " << api_enum);
+    }
+}
+
+bool TransformStep::isSignedApiCall(CallInst* inst,
+                                    FunctionResolver::PsimApiEnum api_enum) {
+    // IR integers are signless, the signedness is taken from the template
+    // argument of the API
+    std::string api_name =
+        vf_info.vm_info.function_resolver.PsimApiEnumStrMap[api_enum];
+    std::string demangled =
+        demangle(inst->getCalledFunction()->getName().str());
+    return demangled.find(api_name + "<unsigned") == std::string::npos;
+}
+
+Constant* TransformStep::getReduceIdentity(ReduceOp op, Type* ty,
+                                           bool is_signed) {
+    if (ty->isFloatingPointTy()) {
+        switch (op) {
+            case REDUCE_ADD:
+                return ConstantFP::getNegativeZero(ty);
+            case REDUCE_MIN:
+                return ConstantFP::getInfinity(ty, false);
+            case REDUCE_MAX:
+                return ConstantFP::getInfinity(ty, true);
+            default:
+                FATAL("Bitwise reduction of floating-point type " << *ty);
+        }
+    }
+
+    unsigned bits = ty->getScalarSizeInBits();
+    switch (op) {
+        case REDUCE_MIN:
+            return ConstantInt::get(ty, is_signed
+                                            ? APInt::getSignedMaxValue(bits)
+                                            : APInt::getMaxValue(bits));
+        case REDUCE_MAX:
+            return ConstantInt::get(ty, is_signed
+                                            ? APInt::getSignedMinValue(bits)
+                                            : APInt::getMinValue(bits));
+        case REDUCE_AND:
+            return Constant::getAllOnesValue(ty);
+        default:
+            return Constant::getNullValue(ty);
+    }
+}
+
+Value* TransformStep::createReduceOp(IRBuilder<>& builder, ReduceOp op,
+                                     bool is_signed, Value* a, Value* b,
+                                     const Twine& name) {
+    bool is_fp = a->getType()->isFPOrFPVectorTy();
+    switch (op) {
+        case REDUCE_ADD:
+            return is_fp ? builder.CreateFAdd(a, b, name)
+                         : builder.CreateAdd(a, b, name);
+        case REDUCE_MIN:
+            if (is_fp) {
+                return builder.CreateMinNum(a, b, name);
+            }
+            return builder.CreateBinaryIntrinsic(
+                is_signed ? Intrinsic::smin : Intrinsic::umin, a, b, nullptr,
+                name);
+        case REDUCE_MAX:
+            if (is_fp) {
+                return builder.CreateMaxNum(a, b, name);
+            }
+            return builder.CreateBinaryIntrinsic(
+                is_signed ? Intrinsic::smax : Intrinsic::umax, a, b, nullptr,
+                name);
+        case REDUCE_AND:
+            return builder.CreateAnd(a, b, name);
+        case REDUCE_OR:
+            return builder.CreateOr(a, b, name);
+    }
+    return nullptr;
+}
+
+// Inclusive scan of the gang vector a: log2(n) steps of "shift up by k lanes
+// and combine" inside chunks of the native vector width, then the last lane
+// of every chunk is carried into the next one
+Value* TransformStep::createGangScan(IRBuilder<>& builder, ReduceOp op,
+                                     bool is_signed, Value* a,
+                                     Constant* identity, const Twine& name) {
+    unsigned elem_bits = a->getType()->getScalarSizeInBits();
+    unsigned reg_bits = 0;
+    switch (FunctionResolver::getTargetIsa(vf_info.VF, vf_info.vfabi)) {
+        case FunctionResolver::ISA_AVX512:
+            reg_bits = 512;
+            break;
+        case FunctionResolver::ISA_AVX2:
+            reg_bits = 256;
+            break;
+        case FunctionResolver::ISA_SSE:
+            reg_bits = 128;
+            break;
+        case FunctionResolver::ISA_GENERIC:
+            break;
+    }
+    unsigned chunk_lanes = num_lanes;
+    if (reg_bits >= elem_bits && reg_bits / elem_bits < num_lanes &&
+        isMultipleOf(num_lanes, reg_bits / elem_bits)) {
+        chunk_lanes = reg_bits / elem_bits;
+    }
+    PRINT_HIGH("Scanning " << num_lanes << " lanes in chunks of "
+                           << chunk_lanes);
+
+    Type* chunk_ty = VectorType::get(a->getType()->getScalarType(),
+                                     getElementCount(chunk_lanes));
+    Value* identity_vec =
+        ConstantVector::getSplat(getElementCount(chunk_lanes), identity);
+
+    std::vector<Value*> chunks;
+    for (unsigned j = 0; j < num_lanes; j += chunk_lanes) {
+        Value* x = a;
+        if (chunk_lanes != num_lanes) {
+            x = builder.CreateExtractVector(chunk_ty, a, builder.getInt64(j),
+                                            name);
+        }
+        for (unsigned k = 1; k < chunk_lanes; k *= 2) {
+            // position 'chunk_lanes' is the first element of identity_vec
+            std::vector<int> indices;
+            for (unsigned i = 0; i < chunk_lanes; i++) {
+                indices.push_back(i < k ? chunk_lanes : i - k);
+            }
+            Value* shifted =
+                builder.CreateShuffleVector(x, identity_vec, indices, name);
+            x = createReduceOp(builder, op, is_signed, x, shifted, name);
+        }
+        if (!chunks.empty()) {
+            Value* carry = builder.CreateExtractElement(
+                chunks.back(), (uint64_t)chunk_lanes - 1, name);
+            carry = builder.CreateVectorSplat(chunk_lanes, carry, name);
+            x = createReduceOp(builder, op, is_signed, carry, x, name);
+        }
+        chunks.push_back(x);
+    }
+
+    if (chunks.size() == 1) {
+        return chunks[0];
+    }
+    return concatenateVectors(builder, chunks);
+}
+
+// Lane i of the result is table[idx[i]], or zero if idx[i] is out of the
+// table. Tables wider than the permute instruction are split into registers,
+// the permute of every register is computed and the right one is selected
+Value* TransformStep::createVariableShuffle(IRBuilder<>& builder, Value* table,
+                                            Value* idx, const Twine& name) {
+    FixedVectorType* table_ty = cast<FixedVectorType>(table->getType());
+    Type* elem_ty = table_ty->getElementType();
+    unsigned table_size = table_ty->getNumElements();
+    Type* idx_ty = idx->getType();
+    Value* zero = Constant::getNullValue(
+        VectorType::get(elem_ty, getElementCount(num_lanes)));
+
+    Value* in_range = builder.CreateICmpULT(
+        idx, ConstantInt::get(idx_ty, table_size), name);
+
+    FunctionResolver& resolver = vf_info.vm_info.function_resolver;
+    FunctionResolver::TargetIsa isa =
+        FunctionResolver::getTargetIsa(vf_info.VF, vf_info.vfabi);
+    unsigned elem_bits = elem_ty->getScalarSizeInBits();
+    FunctionResolver::PermuteIntrinsic perm, perm2;
+    if (!resolver.getPermuteIntrinsic(vf_info.VF, isa, elem_bits, false,
+                                      perm)) {
+        // generic lowering: extract each lane
+        PRINT_HIGH("Generic variable shuffle of " << *table);
+        Value* safe_idx = builder.CreateSelect(
+            in_range, idx, Constant::getNullValue(idx_ty), name);
+        Value* ret = zero;
+        for (unsigned i = 0; i < num_lanes; i++) {
+            Value* lane_idx =
+                builder.CreateExtractElement(safe_idx, (uint64_t)i, name);
+            Value* elem = builder.CreateExtractElement(table, lane_idx, name);
+            ret = builder.CreateInsertElement(ret, elem, (uint64_t)i, name);
+        }
+        return builder.CreateSelect(in_range, ret, zero, name);
+    }
+    bool two_sources = resolver.getPermuteIntrinsic(
+                           vf_info.VF, isa, elem_bits, true, perm2) &&
+                       perm2.nelem == perm.nelem && table_size > perm.nelem;
+
+    unsigned nelem = perm.nelem;
+    unsigned group = two_sources ? 2 * nelem : nelem;
+    Function* intrinsic = Intrinsic::getDeclaration(
+        vf_info.VF->getParent(), two_sources ? perm2.id : perm.id);
+    Type* data_ty = intrinsic->getFunctionType()->getParamType(0);
+    Type* perm_idx_ty = intrinsic->getFunctionType()->getParamType(1);
+    PRINT_HIGH("Variable shuffle of " << *table << " with "
+                                      << intrinsic->getName());
+
+    // pad the table to whole registers and the indices to whole permutes
+    unsigned padded_table_size = roundUp(table_size, group);
+    if (padded_table_size != table_size) {
+        std::vector<int> indices;
+        for (unsigned i = 0; i < padded_table_size; i++) {
+            indices.push_back(i < table_size ? i : table_size);
+        }
+        table = builder.CreateShuffleVector(
+            table, Constant::getNullValue(table_ty), indices, name);
+    }
+    unsigned padded_lanes = roundUp(num_lanes, nelem);
+    Value* padded_idx = idx;
+    if (padded_lanes != num_lanes) {
+        std::vector<int> indices;
+        for (unsigned i = 0; i < padded_lanes; i++) {
+            indices.push_back(i < num_lanes ? i : num_lanes);
+        }
+        padded_idx = builder.CreateShuffleVector(
+            idx, Constant::getNullValue(idx_ty), indices, name);
+    }
+
+    Type* reg_ty = VectorType::get(elem_ty, getElementCount(nelem));
+    std::vector<Value*> regs;
+    for (unsigned j = 0; j < padded_table_size; j += nelem) {
+        Value* reg = table;
+        if (padded_table_size != nelem) {
+            reg = builder.CreateExtractVector(reg_ty, table,
+                                              builder.getInt64(j), name);
+        }
+        regs.push_back(builder.CreateBitCast(reg, data_ty, name));
+    }
+
+    Type* chunk_idx_ty =
+        VectorType::get(idx_ty->getScalarType(), getElementCount(nelem));
+    std::vector<Value*> chunks;
+    for (unsigned c = 0; c < padded_lanes; c += nelem) {
+        Value* chunk_idx = padded_idx;
+        if (padded_lanes != nelem) {
+            chunk_idx = builder.CreateExtractVector(
+                chunk_idx_ty, padded_idx, builder.getInt64(c), name);
+        }
+        // position within the group of registers, and which group
+        Value* local_idx = builder.CreateAnd(
+            chunk_idx, ConstantInt::get(chunk_idx_ty, group - 1), name);
+        local_idx = builder.CreateZExtOrTrunc(local_idx, perm_idx_ty, name);
+        Value* group_idx = builder.CreateLShr(
+            chunk_idx, ConstantInt::get(chunk_idx_ty, Log2_32(group)), name);
+
+        Value* chunk = nullptr;
+        for (unsigned g = 0; g * group < padded_table_size; g++) {
+            Value* res;
+            if (two_sources) {
+                res = builder.CreateCall(
+                    intrinsic, {regs[2 * g], local_idx, regs[2 * g + 1]}, name);
+            } else {
+                res = builder.CreateCall(intrinsic, {regs[g], local_idx}, name);
+            }
+            res = builder.CreateBitCast(res, reg_ty, name);
+            if (!chunk) {
+                chunk = res;
+            } else {
+                Value* cmp = builder.CreateICmpEQ(
+                    group_idx, ConstantInt::get(chunk_idx_ty, g), name);
+                chunk = builder.CreateSelect(cmp, res, chunk, name);
+            }
+        }
+        chunks.push_back(chunk);
+    }
+
+    Value* ret =
+        chunks.size() == 1 ? chunks[0] : concatenateVectors(builder, chunks);
+    if (padded_lanes != num_lanes) {
+        ret = builder.CreateExtractVector(
+            VectorType::get(elem_ty, getElementCount(num_lanes)), ret,
+            builder.getInt64(0), name);
+    }
+    return builder.CreateSelect(in_range, ret, zero, name);
+}
+
 Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
     Function* f = inst->getCalledFunction();
 
@@ -653,23 +1136,26 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
 
             Shape sidx = value_cache.getShape(idx);
             PRINT_HIGH("Shuffle pattern is " << sidx.toString());
-            ASSERT(sidx.isIndexed() && sidx.hasConstantBase(),
-                   "shuffle pattern cannot be reduced to const operation "
-                       << *idx << " " << sidx.toString());
-
-            std::vector<Constant*> vidxs;
-            for (int64_t i = 0; i < num_lanes; i++) {
-                uint64_t idx = sidx.getValueAtLane(i);
-                if (idx >= 0 && idx < num_lanes * num_value_operands) {
-                    vidxs.push_back(builder.getInt32(idx));
-                } else {
-                    // Results in zero value
-                    vidxs.push_back(
-                        builder.getInt32(static_cast<int32_t>(num_lanes + i)));
+            // indices that are not known at compile time need a variable
+            // permute
+            bool const_idx = sidx.isIndexed() && sidx.hasConstantBase();
+
+            Value* idxs = nullptr;
+            if (const_idx) {
+                std::vector<Constant*> vidxs;
+                for (int64_t i = 0; i < num_lanes; i++) {
+                    uint64_t idx = sidx.getValueAtLane(i);
+                    if (idx >= 0 && idx < num_lanes * num_value_operands) {
+                        vidxs.push_back(builder.getInt32(idx));
+                    } else {
+                        // Results in zero value
+                        vidxs.push_back(builder.getInt32(
+                            static_cast<int32_t>(num_lanes + i)));
+                    }
                 }
+                idxs = ConstantVector::get(vidxs);
+                PRINT_HIGH("shuffle Idx " << *idxs);
             }
-            Value* idxs = ConstantVector::get(vidxs);
-            PRINT_HIGH("shuffle Idx " << *idxs);
 
             unsigned from_bits = va->getType()->getScalarSizeInBits();
             unsigned to_bits = ret_type->getScalarSizeInBits();
@@ -683,8 +1169,14 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             PRINT_HIGH("bits_ratio: " << bits_ratio);
 
             Value* shfl = nullptr;
-            if (from_bits == to_bits || !is_unsigned ||
-                from_bits * bits_ratio != to_bits) {
+            if (!const_idx) {
+                Value* table = num_value_operands == 1
+                                   ? va
+                                   : concatenateVectors(builder, {va, vb});
+                shfl = createVariableShuffle(
+                    builder, table, value_cache.getVectorValue(idx), name);
+            } else if (from_bits == to_bits || !is_unsigned ||
+                       from_bits * bits_ratio != to_bits) {
                 shfl = builder.CreateShuffleVector(va, vb, idxs, name);
             }
 
@@ -692,7 +1184,8 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             if (from_bits == to_bits) {
                 PRINT_HIGH("from_bits == to_bits");
                 ret = shfl;
-            } else if (is_unsigned && from_bits * bits_ratio == to_bits) {
+            } else if (const_idx && is_unsigned &&
+                       from_bits * bits_ratio == to_bits) {
                 PRINT_HIGH("zero extend and shuffle");
                 // Built-in zero extend
                 std::vector<Value*> vectors;
@@ -748,19 +1241,36 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             return ret;
         }
         case FunctionResolver::PsimApiEnum::UMULH: {
-            llvm::Intrinsic::ID id =
-                vf_info.vm_info.function_resolver.Avx512InstrinsicMap[api_enum];
-            Function* intrinsic =
-                Intrinsic::getDeclaration(inst->getModule(), id);
+            FunctionResolver& resolver = vf_info.vm_info.function_resolver;
+            FunctionResolver::TargetIntrinsic target_intrinsic;
 
-            // instrinsic works on 32 elements, maybe have this on a table
-            int nelem = 32;
-            Type* vty = VectorType::get(inst->getType(), nelem, false);
-            std::vector<Value*> part_res;
             // for now operate on vector value (even if operand was uniform)
             Value* a = value_cache.getVectorValue(inst->getOperand(0));
             Value* b = value_cache.getVectorValue(inst->getOperand(1));
 
+            if (!resolver.getTargetIntrinsic(
+                    api_enum,
+                    FunctionResolver::getTargetIsa(vf_info.VF, vf_info.vfabi),
+                    num_lanes, target_intrinsic)) {
+                // generic lowering: high half of the double-width product
+                unsigned bits = inst->getType()->getScalarSizeInBits();
+                Type* wide_ty = VectorType::get(
+                    builder.getIntNTy(2 * bits), num_lanes, false);
+                Value* wa = builder.CreateZExt(a, wide_ty, name);
+                Value* wb = builder.CreateZExt(b, wide_ty, name);
+                Value* ret = builder.CreateMul(wa, wb, name);
+                ret = builder.CreateLShr(ret, bits, name);
+                ret = builder.CreateTrunc(ret, a->getType(), name);
+                value_cache.setToBeDeleted(inst);
+                return ret;
+            }
+
+            Function* intrinsic = Intrinsic::getDeclaration(
+                inst->getModule(), target_intrinsic.id);
+            uint32_t nelem = target_intrinsic.nelem;
+            Type* vty = VectorType::get(inst->getType(), nelem, false);
+            std::vector<Value*> part_res;
+
             for (uint32_t j = 0; j < num_lanes; j += nelem) {
                 Value* idx = ConstantInt::get(i64, j);
                 Value* sa = builder.CreateExtractVector(vty, a, idx, name);
@@ -791,24 +1301,21 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             }
             name = "csad.";
 
-            llvm::Intrinsic::ID id =
-                vf_info.vm_info.function_resolver.Avx512InstrinsicMap[api_enum];
-            Function* intrinsic =
-                Intrinsic::getDeclaration(inst->getModule(), id);
-
-            Type* IntrinsicOpType = intrinsic->getArg(0)->getType();
             PointerType* ptr_ty =
                 dyn_cast<PointerType>(inst->getOperand(0)->getType());
             assert(ptr_ty);
-            Type* ty = ptr_ty->getNonOpaquePointerElementType();
+            StructType* ty =
+                dyn_cast<StructType>(ptr_ty->getNonOpaquePointerElementType());
             assert(ty);
             Value* gep = builder.CreateGEP(
                 ty, inst->getOperand(0),
                 {builder.getInt32(0), builder.getInt32(0)}, name);
-            Type* vty = intrinsic->getReturnType();
-            Value* acc = builder.CreateLoad(vty, gep, name);
 
-            uint32_t nelem = 64;
+            // The accumulator holds N_ARCH 64-bit partial sums, only their
+            // total is observable through ReduceSum()
+            Type* acc_ty = ty->getElementType(0);
+            Value* acc = builder.CreateLoad(acc_ty, gep, name);
+            Value* acc_zero = Constant::getNullValue(acc_ty);
 
             Value* a = value_cache.getVectorValue(inst->getOperand(1));
             Value* b = value_cache.getVectorValue(inst->getOperand(2));
@@ -820,27 +1327,50 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             a = builder.CreateSelect(mask, a, zero, name);
             b = builder.CreateSelect(mask, b, zero, name);
 
+            FunctionResolver& resolver = vf_info.vm_info.function_resolver;
+            FunctionResolver::TargetIntrinsic target_intrinsic;
+            if (!resolver.getTargetIntrinsic(
+                    api_enum,
+                    FunctionResolver::getTargetIsa(vf_info.VF, vf_info.vfabi),
+                    num_lanes, target_intrinsic)) {
+                // generic lowering: add the sum of all |a - b| to the first
+                // partial sum
+                Value* cmp = builder.CreateICmpUGT(a, b, name);
+                Value* diff = builder.CreateSelect(cmp, builder.CreateSub(a, b),
+                                                   builder.CreateSub(b, a),
+                                                   name);
+                diff = builder.CreateZExt(
+                    diff, VectorType::get(i64, num_lanes, false), name);
+                Value* sum = builder.CreateAddReduce(diff);
+                acc = builder.CreateAdd(
+                    acc,
+                    builder.CreateInsertElement(acc_zero, sum, (uint64_t)0),
+                    name);
+                builder.CreateStore(acc, gep, false);
+                value_cache.setToBeDeleted(inst);
+                return inst;
+            }
+
+            Function* intrinsic = Intrinsic::getDeclaration(
+                inst->getModule(), target_intrinsic.id);
+            uint32_t nelem = target_intrinsic.nelem;
+            Type* eTy = VectorType::get(builder.getInt8Ty(), nelem, false);
+
             for (uint32_t j = 0; j < num_lanes; j += nelem) {
                 Value* idx = ConstantInt::get(i64, j);
-                int actual_nelem = std::min(nelem, num_lanes - j);
-                Type* eTy =
-                    VectorType::get(builder.getInt8Ty(), actual_nelem, false);
                 Value* sa = builder.CreateExtractVector(eTy, a, idx, name);
                 Value* sb = builder.CreateExtractVector(eTy, b, idx, name);
 
-                Value* sae =
-                    builder.CreateVectorSplat(nelem, builder.getInt8(0), name);
-                sae = builder.CreateInsertVector(IntrinsicOpType, sae, sa,
-                                                 builder.getInt64(0), name);
-
-                Value* sbe =
-                    builder.CreateVectorSplat(nelem, builder.getInt8(0), name);
-                sbe = builder.CreateInsertVector(IntrinsicOpType, sbe, sb,
-                                                 builder.getInt64(0), name);
                 SmallVector<Value*> args;
-                args.push_back(sae);
-                args.push_back(sbe);
+                args.push_back(sa);
+                args.push_back(sb);
                 Value* sc = builder.CreateCall(intrinsic, args, name);
+
+                // narrower ISAs produce fewer partial sums than N_ARCH
+                if (sc->getType() != acc_ty) {
+                    sc = builder.CreateInsertVector(acc_ty, acc_zero, sc,
+                                                    builder.getInt64(0), name);
+                }
                 acc = builder.CreateAdd(acc, sc, name);
             }
 
@@ -889,6 +1419,284 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
             return inst;
         }
 
+        case FunctionResolver::PsimApiEnum::REDUCE_ADD_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_MIN_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_MAX_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_AND_SYNC:
+        case FunctionResolver::PsimApiEnum::REDUCE_OR_SYNC: {
+            name = "reduce.";
+
+            PointerType* ptr_ty =
+                dyn_cast<PointerType>(inst->getOperand(0)->getType());
+            assert(ptr_ty);
+            StructType* ty =
+                dyn_cast<StructType>(ptr_ty->getNonOpaquePointerElementType());
+            assert(ty);
+            Value* gep = builder.CreateGEP(
+                ty, inst->getOperand(0),
+                {builder.getInt32(0), builder.getInt32(0)}, name);
+
+            // The accumulator holds N_ARCH partial results that are combined
+            // lane-wise with the gang, only Reduce() combines them together
+            FixedVectorType* acc_ty =
+                dyn_cast<FixedVectorType>(ty->getElementType(0));
+            assert(acc_ty);
+            Type* elem_ty = acc_ty->getElementType();
+            unsigned n_arch = acc_ty->getNumElements();
+            Value* acc = builder.CreateLoad(acc_ty, gep, name);
+
+            Value* a = value_cache.getVectorValue(inst->getOperand(1));
+            if (a->getType()->getScalarType() != elem_ty) {
+                FATAL("Can't transform " << *inst);
+            }
+            ReduceOp op = getReduceOp(api_enum);
+            bool is_signed = isSignedApiCall(inst, api_enum);
+            Constant* identity = getReduceIdentity(op, elem_ty, is_signed);
+
+            // inactive lanes contribute the identity of the operation
+            Value* mask = value_cache.getVectorValue(
+                vf_info.bb_masks[inst->getParent()].active_mask);
+            Value* identity_vec =
+                ConstantVector::getSplat(getElementCount(num_lanes), identity);
+            a = builder.CreateSelect(mask, a, identity_vec, name);
+
+            if (n_arch == 1) {
+                // floating-point sum without reassociation: add the lanes in
+                // order to the single partial sum
+                assert(elem_ty->isFloatingPointTy());
+                Value* sum = builder.CreateExtractElement(acc, (uint64_t)0);
+                sum = builder.CreateFAddReduce(sum, a);
+                acc = builder.CreateInsertElement(acc, sum, (uint64_t)0, name);
+            } else {
+                // pad the gang with the identity up to a multiple of N_ARCH
+                // and fold it into the partial results chunk by chunk
+                unsigned padded_lanes = roundUp(num_lanes, n_arch);
+                if (padded_lanes != num_lanes) {
+                    std::vector<int> indices;
+                    for (unsigned i = 0; i < padded_lanes; i++) {
+                        indices.push_back(i < num_lanes ? i : num_lanes);
+                    }
+                    a = builder.CreateShuffleVector(a, identity_vec, indices,
+                                                    name);
+                }
+                for (unsigned j = 0; j < padded_lanes; j += n_arch) {
+                    Value* part = a;
+                    if (padded_lanes != n_arch) {
+                        part = builder.CreateExtractVector(
+                            acc_ty, a, builder.getInt64(j), name);
+                    }
+                    acc = createReduceOp(builder, op, is_signed, acc, part,
+                                         name);
+                }
+            }
+
+            builder.CreateStore(acc, gep, false);
+            value_cache.setToBeDeleted(inst);
+            return inst;
+        }
+
+        case FunctionResolver::PsimApiEnum::SCAN_ADD_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MIN_SYNC:
+        case FunctionResolver::PsimApiEnum::SCAN_MAX_SYNC: {
+            name = "scan.";
+
+            // psim_scan_*_sync(value, inclusive) or
+            // psim_scan_*_sync(carry, value, inclusive)
+            bool has_carry = inst->arg_size() == 3;
+            Value* a = value_cache.getVectorValue(
+                inst->getArgOperand(has_carry ? 1 : 0));
+            Value* inclusive = inst->getArgOperand(has_carry ? 2 : 1);
+            Type* elem_ty = a->getType()->getScalarType();
+
+            ReduceOp op = getReduceOp(api_enum);
+            bool is_signed = isSignedApiCall(inst, api_enum);
+            Constant* identity = getReduceIdentity(op, elem_ty, is_signed);
+            Value* identity_vec =
+                ConstantVector::getSplat(getElementCount(num_lanes), identity);
+
+            // inactive lanes contribute the identity of the operation
+            Value* mask = value_cache.getVectorValue(
+                vf_info.bb_masks[inst->getParent()].active_mask);
+            a = builder.CreateSelect(mask, a, identity_vec, name);
+
+            Value* inc = createGangScan(builder, op, is_signed, a, identity,
+                                        name);
+            // exclusive scan: shift the inclusive scan up by one lane
+            std::vector<int> indices;
+            for (unsigned i = 0; i < num_lanes; i++) {
+                indices.push_back(i == 0 ? num_lanes : i - 1);
+            }
+            Value* exc =
+                builder.CreateShuffleVector(inc, identity_vec, indices, name);
+
+            Value* ret;
+            if (ConstantInt* c = dyn_cast<ConstantInt>(inclusive)) {
+                ret = c->isZero() ? exc : inc;
+            } else {
+                ret = builder.CreateSelect(
+                    value_cache.getVectorValue(inclusive), inc, exc, name);
+            }
+
+            if (has_carry) {
+                // continue the scan of the previous gangs, and add this gang
+                PointerType* ptr_ty =
+                    dyn_cast<PointerType>(inst->getArgOperand(0)->getType());
+                assert(ptr_ty);
+                StructType* ty = dyn_cast<StructType>(
+                    ptr_ty->getNonOpaquePointerElementType());
+                assert(ty && ty->getElementType(0) == elem_ty);
+                Value* gep = builder.CreateGEP(
+                    ty, inst->getArgOperand(0),
+                    {builder.getInt32(0), builder.getInt32(0)}, name);
+                Value* carry = builder.CreateLoad(elem_ty, gep, name);
+                ret = createReduceOp(
+                    builder, op, is_signed,
+                    builder.CreateVectorSplat(num_lanes, carry, name), ret,
+                    name);
+                Value* gang_total = builder.CreateExtractElement(
+                    inc, (uint64_t)num_lanes - 1, name);
+                carry = createReduceOp(builder, op, is_signed, carry,
+                                       gang_total, name);
+                builder.CreateStore(carry, gep, false);
+            }
+
+            value_cache.setToBeDeleted(inst);
+            return ret;
+        }
+
+        case FunctionResolver::PsimApiEnum::COMPRESS_STORE:
+        case FunctionResolver::PsimApiEnum::EXPAND_LOAD: {
+            bool is_store =
+                api_enum == FunctionResolver::PsimApiEnum::COMPRESS_STORE;
+            name = is_store ? "compress." : "expand.";
+
+            // the active lanes access consecutive elements from ptr
+            Value* ptr = inst->getArgOperand(0);
+            if (!value_cache.getShape(ptr).isUniform()) {
+                FATAL("The pointer of " << *inst << " must be uniform");
+            }
+            ptr = value_cache.getScalarValue(ptr);
+            Value* mask = value_cache.getVectorValue(
+                vf_info.bb_masks[inst->getParent()].active_mask);
+
+            if (!is_store) {
+                Type* vty = vf_info.vectorizeType(inst->getType());
+                Function* intrinsic = Intrinsic::getDeclaration(
+                    inst->getModule(), Intrinsic::masked_expandload, {vty});
+                Value* ret = builder.CreateCall(
+                    intrinsic, {ptr, mask, UndefValue::get(vty)}, name);
+                value_cache.setToBeDeleted(inst);
+                return ret;
+            }
+
+            Value* a = value_cache.getVectorValue(inst->getArgOperand(1));
+            Function* intrinsic = Intrinsic::getDeclaration(
+                inst->getModule(), Intrinsic::masked_compressstore,
+                {a->getType()});
+            builder.CreateCall(intrinsic, {a, ptr, mask});
+
+            // number of elements written: the number of active lanes
+            Value* bits = builder.CreateBitCast(
+                mask, builder.getIntNTy(num_lanes), name);
+            Value* count = builder.CreateUnaryIntrinsic(Intrinsic::ctpop,
+                                                        bits, nullptr, name);
+            count = builder.CreateZExtOrTrunc(count, inst->getType(), name);
+            value_cache.setToBeDeleted(inst);
+            return count;
+        }
+
+        case FunctionResolver::PsimApiEnum::BALLOT_SYNC:
+        case FunctionResolver::PsimApiEnum::ANY_SYNC:
+        case FunctionResolver::PsimApiEnum::ALL_SYNC:
+        case FunctionResolver::PsimApiEnum::POPC_SYNC:
+        case FunctionResolver::PsimApiEnum::FIRST_ACTIVE_LANE: {
+            name = "vote.";
+
+            Value* mask = value_cache.getVectorValue(
+                vf_info.bb_masks[inst->getParent()].active_mask);
+            Type* bits_ty = builder.getIntNTy(num_lanes);
+            Value* ret;
+
+            if (api_enum == FunctionResolver::PsimApiEnum::FIRST_ACTIVE_LANE) {
+                // num_lanes if no lane is active
+                Value* bits = builder.CreateBitCast(mask, bits_ty, name);
+                ret = builder.CreateBinaryIntrinsic(
+                    Intrinsic::cttz, bits, builder.getFalse(), nullptr, name);
+                ret = builder.CreateZExtOrTrunc(ret, inst->getType(), name);
+                value_cache.setToBeDeleted(inst);
+                return ret;
+            }
+
+            Value* pred = value_cache.getVectorValue(inst->getArgOperand(0));
+            if (api_enum == FunctionResolver::PsimApiEnum::ALL_SYNC) {
+                // no active lane has a false predicate
+                Value* fails = builder.CreateAnd(
+                    mask, builder.CreateNot(pred, name), name);
+                Value* bits = builder.CreateBitCast(fails, bits_ty, name);
+                ret = builder.CreateICmpEQ(
+                    bits, Constant::getNullValue(bits_ty), name);
+                value_cache.setToBeDeleted(inst);
+                return ret;
+            }
+
+            Value* votes = builder.CreateAnd(mask, pred, name);
+            Value* bits = builder.CreateBitCast(votes, bits_ty, name);
+            switch (api_enum) {
+                case FunctionResolver::PsimApiEnum::BALLOT_SYNC: {
+                    // 64-bit word 'word' of the bitmap of the gang
+                    Value* word = inst->getArgOperand(1);
+                    if (!value_cache.getShape(word).isUniform()) {
+                        FATAL("The word of " << *inst << " must be uniform");
+                    }
+                    word = value_cache.getScalarValue(word);
+                    if (num_lanes > 64) {
+                        word = builder.CreateZExtOrTrunc(word, bits_ty, name);
+                        Value* shift = builder.CreateMul(
+                            word, ConstantInt::get(bits_ty, 64), name);
+                        // shifting by num_lanes or more is poison, the words
+                        // past the end of the gang are empty
+                        Value* in_range = builder.CreateICmpULT(
+                            shift, ConstantInt::get(bits_ty, num_lanes), name);
+                        bits = builder.CreateSelect(
+                            in_range, builder.CreateLShr(bits, shift, name),
+                            Constant::getNullValue(bits_ty), name);
+                    } else {
+                        // words other than 0 are empty
+                        Value* is_first = builder.CreateICmpEQ(
+                            word, Constant::getNullValue(word->getType()),
+                            name);
+                        bits = builder.CreateSelect(
+                            is_first, bits, Constant::getNullValue(bits_ty),
+                            name);
+                    }
+                    ret = builder.CreateZExtOrTrunc(bits, inst->getType(),
+                                                    name);
+                    break;
+                }
+                case FunctionResolver::PsimApiEnum::ANY_SYNC:
+                    ret = builder.CreateICmpNE(
+                        bits, Constant::getNullValue(bits_ty), name);
+                    break;
+                default:
+                    ret = builder.CreateUnaryIntrinsic(Intrinsic::ctpop, bits,
+                                                       nullptr, name);
+                    ret = builder.CreateZExtOrTrunc(ret, inst->getType(), name);
+                    break;
+            }
+            value_cache.setToBeDeleted(inst);
+            return ret;
+        }
+
+        case FunctionResolver::PsimApiEnum::NONTEMPORAL: {
+            Value* ptr = inst->getArgOperand(0);
+            markNontemporalStores(inst);
+            value_cache.setToBeDeleted(inst);
+            if (value_cache.getShape(inst).isUniform()) {
+                return value_cache.getScalarValue(ptr);
+            }
+            return value_cache.getVectorValue(ptr);
+        }
+
         default:
             FATAL("dont' know how to transform " << *inst);
             break;
@@ -896,120 +1704,199 @@ Value* TransformStep::transformCallPsimApi(llvm::CallInst* inst) {
     return nullptr;
 }
 
+// libm name without the 'f' of the float variant, for the libm functions
+// and the LLVM intrinsics that vector math handles
+static std::string getVmathBaseName(Function* f, bool is_float) {
+    if (f->isIntrinsic()) {
+        switch (f->getIntrinsicID()) {
+            case Intrinsic::exp:
+                return "exp";
+            case Intrinsic::exp2:
+                return "exp2";
+            case Intrinsic::log:
+                return "log";
+            case Intrinsic::log2:
+                return "log2";
+            case Intrinsic::log10:
+                return "log10";
+            case Intrinsic::pow:
+                return "pow";
+            case Intrinsic::sin:
+                return "sin";
+            case Intrinsic::cos:
+                return "cos";
+            default:
+                return "";
+        }
+    }
+    std::string name = f->getName().str();
+    if (!is_float) {
+        return name;
+    }
+    if (name.empty() || name.back() != 'f') {
+        return "";
+    }
+    return name.substr(0, name.size() - 1);
+}
+
 Value* TransformStep::transformCallVmath(llvm::CallInst* inst) {
     Function* f = inst->getCalledFunction();
-    std::string name = f->getName().str();
-    PRINT_HIGH("original math function " << *f);
+    Type* scalar_ret_ty = f->getFunctionType()->getReturnType();
+    if (!scalar_ret_ty->isFloatTy() && !scalar_ret_ty->isDoubleTy()) {
+        return nullptr;
+    }
+    for (Type* param_ty : f->getFunctionType()->params()) {
+        if (param_ty != scalar_ret_ty) {
+            return nullptr;
+        }
+    }
+    bool is_float = scalar_ret_ty->isFloatTy();
+    std::string base_name = getVmathBaseName(f, is_float);
+    if (base_name.empty()) {
+        return nullptr;
+    }
+
+    // functions that LLVM lowers to vector instructions
     // clang-format off
-    const std::unordered_map<std::string, std::string> sleef_func_map = {
-        {"expf", "Sleef_expf#_u10"},
-        {"exp", "Sleef_expd#_u10"},
-        {"cos", "Sleef_cosd#_u10"},
-        {"cosf", "Sleef_cosf#_u10"},
-        {"sin", "Sleef_sind#_u10"},
-        {"sinf", "Sleef_sinf#_u10"},
-        {"sqrtf", "Sleef_sqrtf#"},
-        {"sqrt", "Sleef_sqrtd#"},
-        {"logf", "Sleef_logf#_u10"},
-        {"logd", "Sleef_logd#_u10"},
-        {"powf", "Sleef_powf#_u10"},
-        {"pow", "Sleef_powd#_u10"},
-        {"fabsf", "Sleef_fabsf#"},
-        {"fabs", "Sleef_fabsd#"},
-        {"fmax", "Sleef_fmaxd#"},
-        {"fmaxf", "Sleef_fmaxf#"},
+    static const std::unordered_map<std::string, Intrinsic::ID>
+        vmath_intrinsics = {
+        {"floor", Intrinsic::floor},     {"ceil", Intrinsic::ceil},
+        {"trunc", Intrinsic::trunc},     {"round", Intrinsic::round},
+        {"rint", Intrinsic::rint},       {"nearbyint", Intrinsic::nearbyint},
+        {"fabs", Intrinsic::fabs},       {"sqrt", Intrinsic::sqrt},
+        {"fma", Intrinsic::fma},         {"fmin", Intrinsic::minnum},
+        {"fmax", Intrinsic::maxnum},     {"copysign", Intrinsic::copysign},
+    };
 
+#ifdef SLEEF_ENABLE
+    // Sleef function and ULP suffixes of math(precise) and math(fast): "sin"
+    // is mapped to Sleef_sind<N>_u10 and "sinf" to Sleef_sinf<N>_u10 (or
+    // _u35 with math(fast)), <N> being the number of elements
+    static const std::unordered_map<std::string,
+                                    std::pair<std::string, std::string>>
+        sleef_funcs = {
+        {"sin", {"_u10", "_u35"}},    {"cos", {"_u10", "_u35"}},
+        {"tan", {"_u10", "_u35"}},    {"asin", {"_u10", "_u35"}},
+        {"acos", {"_u10", "_u35"}},   {"atan", {"_u10", "_u35"}},
+        {"atan2", {"_u10", "_u35"}},  {"sinh", {"_u10", "_u35"}},
+        {"cosh", {"_u10", "_u35"}},   {"tanh", {"_u10", "_u35"}},
+        {"asinh", {"_u10", "_u10"}},  {"acosh", {"_u10", "_u10"}},
+        {"atanh", {"_u10", "_u10"}},  {"sinpi", {"_u05", "_u05"}},
+        {"cospi", {"_u05", "_u05"}},  {"exp", {"_u10", "_u10"}},
+        {"exp2", {"_u10", "_u35"}},   {"exp10", {"_u10", "_u35"}},
+        {"expm1", {"_u10", "_u10"}},  {"log", {"_u10", "_u35"}},
+        {"log2", {"_u10", "_u35"}},   {"log10", {"_u10", "_u10"}},
+        {"log1p", {"_u10", "_u10"}},  {"pow", {"_u10", "_u10"}},
+        {"cbrt", {"_u10", "_u35"}},   {"hypot", {"_u05", "_u35"}},
+        {"erf", {"_u10", "_u10"}},    {"erfc", {"_u15", "_u15"}},
+        {"tgamma", {"_u10", "_u10"}}, {"lgamma", {"_u10", "_u10"}},
+        {"fmod", {"", ""}},           {"remainder", {"", ""}},
+        {"fdim", {"", ""}},
     };
+#endif
     // clang-format on
 
-    std::string sleef_func_name = "";
-    if (sleef_func_map.find(name) != sleef_func_map.end()) {
-        sleef_func_name = sleef_func_map.at(name);
-    } else {
+    MathAccuracy accuracy = vf_info.getMathAccuracy();
+    std::string fallback_name = base_name + "f";
+    bool fallback = is_float && hasVmathFallback(fallback_name,
+                                                 accuracy == MATH_PRECISE);
+    // math(approx) prefers the in-tree approximations even to Sleef
+    bool approx = fallback && accuracy == MATH_APPROX;
+
+    std::string sleef_func_name;
+    auto intrinsic = vmath_intrinsics.find(base_name);
+#ifdef SLEEF_ENABLE
+    if (intrinsic == vmath_intrinsics.end() && !approx) {
+        auto sleef = sleef_funcs.find(base_name);
+        if (sleef != sleef_funcs.end()) {
+            sleef_func_name = "Sleef_" + base_name + (is_float ? "f" : "d") +
+                              "#" +
+                              (accuracy == MATH_PRECISE ? sleef->second.first
+                                                        : sleef->second.second);
+        }
+    }
+#endif
+    if (intrinsic == vmath_intrinsics.end() && sleef_func_name.empty() &&
+        !fallback) {
         return nullptr;
     }
+    PRINT_HIGH("original math function " << *f);
 
-    // TODO  this should come from the target architecture
-    int max_bit_width = 512;
-    Type* scalar_ret_ty = f->getFunctionType()->getReturnType();
-    TypeSize scalar_ret_ty_size =
-        vf_info.data_layout.getTypeAllocSize(scalar_ret_ty->getScalarType());
-    int fixed_size = scalar_ret_ty_size.getFixedSize();
-    unsigned nelem = max_bit_width / (fixed_size * 8);
+    SmallVector<Value*> args;
+    for (Use& arg : inst->args()) {
+        args.push_back(value_cache.getVectorValue(arg));
+    }
 
-    /* replace # with "nelem" */
-    size_t index = sleef_func_name.find("#");
-    assert(index != std::string::npos);
-    std::string l = std::to_string(nelem);
-    sleef_func_name.replace(index, 1, l.c_str());
-
-    SmallVector<Type*> vec_argsTy;
-    for (uint32_t i = 0; i < f->getFunctionType()->getNumParams(); i++) {
-        Type* scalar_arg_ty = f->getFunctionType()->getParamType(i);
-        Type* vec_arg_ty =
-            VectorType::get(scalar_arg_ty, getElementCount(nelem));
-        vec_argsTy.push_back(vec_arg_ty);
-    }
-
-    Type* vec_ret_ty = VectorType::get(scalar_ret_ty, getElementCount(nelem));
-    Module* mod = inst->getModule();
-    FunctionCallee sleef_func;
-    if (f->getFunctionType()->getNumParams() == 1) {
-        sleef_func = mod->getOrInsertFunction(sleef_func_name.c_str(),
-                                              vec_ret_ty, vec_argsTy[0]);
-    } else if (f->getFunctionType()->getNumParams() == 2) {
-        sleef_func = mod->getOrInsertFunction(
-            sleef_func_name.c_str(), vec_ret_ty, vec_argsTy[0], vec_argsTy[1]);
+    IRBuilder<> builder(inst->getParent());
+    builder.SetInsertPoint(inst->getNextNode());
+
+    Value* ret;
+    std::string emitted;
+    if (intrinsic != vmath_intrinsics.end()) {
+        ret = builder.CreateIntrinsic(intrinsic->second,
+                                      {vf_info.vectorizeType(scalar_ret_ty)},
+                                      args, nullptr, inst->getName());
+        emitted = Intrinsic::getBaseName(intrinsic->second).str();
+    } else if (!sleef_func_name.empty()) {
+        ret = createSleefCall(builder, sleef_func_name, scalar_ret_ty, args,
+                              inst->getName());
+        emitted = sleef_func_name;
+        emitted.replace(emitted.find("#"), 1, "<N>");
     } else {
-        sleef_func = NULL;
-        PRINT_HIGH("VMath call not supported "
-                   << *inst << " Num params: "
-                   << f->getFunctionType()->getNumParams() << "\n");
-        return nullptr;
+        ret = createVmathFallback(builder, fallback_name, args, approx);
+        emitted = approx ? "in-tree approximation" : "in-tree polynomial";
     }
+    vf_info.diagnostics.vmath_functions.insert(f->getName().str() + " -> " +
+                                               emitted);
+    PRINT_HIGH("transformed math function " << *ret);
+    value_cache.setToBeDeleted(inst);
+    return ret;
+}
 
-    PRINT_HIGH("transformed math function " << *sleef_func.getCallee());
-
-    Value* a = value_cache.getVectorValue(inst->getOperand(0));
-    Value* b = nullptr;
-    if (f->getFunctionType()->getNumParams() == 2)
-        b = value_cache.getVectorValue(inst->getOperand(1));
+Value* TransformStep::createSleefCall(IRBuilder<>& builder,
+                                      std::string sleef_func_name,
+                                      Type* scalar_ty, ArrayRef<Value*> args,
+                                      const Twine& name) {
+    // the widest Sleef functions unless the target ISA is known to be
+    // narrower
+    int max_bit_width = 512;
+    switch (FunctionResolver::getTargetIsa(vf_info.VF, vf_info.vfabi)) {
+        case FunctionResolver::ISA_AVX2:
+            max_bit_width = 256;
+            break;
+        case FunctionResolver::ISA_SSE:
+            max_bit_width = 128;
+            break;
+        default:
+            break;
+    }
+    TypeSize scalar_ty_size = vf_info.data_layout.getTypeAllocSize(scalar_ty);
+    unsigned nelem = max_bit_width / (scalar_ty_size.getFixedSize() * 8);
 
-    IRBuilder<> builder(inst->getParent());
-    builder.SetInsertPoint(inst->getNextNode());
+    /* replace # with "nelem" */
+    size_t index = sleef_func_name.find("#");
+    assert(index != std::string::npos);
+    sleef_func_name.replace(index, 1, std::to_string(nelem));
 
-    Type* vty_a = VectorType::get(
-        inst->getOperand(0)->getType()->getScalarType(), nelem, false);
-    Type* vty_b = nullptr;
-    if (f->getFunctionType()->getNumParams() == 2)
-        vty_b = VectorType::get(inst->getOperand(1)->getType()->getScalarType(),
-                                nelem, false);
+    Type* vty = VectorType::get(scalar_ty, getElementCount(nelem));
+    SmallVector<Type*> vec_args_ty(args.size(), vty);
+    Module* mod = builder.GetInsertBlock()->getModule();
+    FunctionCallee sleef_func = mod->getOrInsertFunction(
+        sleef_func_name, FunctionType::get(vty, vec_args_ty, false));
 
-    Type* i64 = Type::getInt64Ty(inst->getContext());
-    Type* ret_ty = VectorType::get(scalar_ret_ty, getElementCount(num_lanes));
-    std::vector<Value*> part_res;
+    Type* i64 = Type::getInt64Ty(builder.getContext());
+    Type* ret_ty = VectorType::get(scalar_ty, getElementCount(num_lanes));
+    Value* ret = UndefValue::get(ret_ty);
     for (uint32_t j = 0; j < num_lanes; j += nelem) {
         Value* idx = ConstantInt::get(i64, j);
-        Value* sa = builder.CreateExtractVector(vty_a, a, idx, name);
-        SmallVector<Value*> args;
-        args.push_back(sa);
-        if (b) {
-            Value* sb = builder.CreateExtractVector(vty_b, b, idx, name);
-            args.push_back(sb);
+        SmallVector<Value*> part_args;
+        for (Value* arg : args) {
+            part_args.push_back(
+                builder.CreateExtractVector(vty, arg, idx, name));
         }
-
-        Value* sc = builder.CreateCall(sleef_func, args, name);
-        part_res.push_back(sc);
+        Value* part_res = builder.CreateCall(sleef_func, part_args, name);
+        ret = builder.CreateInsertVector(ret_ty, ret, part_res, idx, name);
     }
-
-    Value* ret = UndefValue::get(ret_ty);
-    int j = 0;
-    for (auto pr : part_res) {
-        Value* idx = ConstantInt::get(i64, j * nelem);
-        ret = builder.CreateInsertVector(ret_ty, ret, pr, idx, name);
-        j++;
-    }
-    value_cache.setToBeDeleted(inst);
     return ret;
 }
 
@@ -1098,12 +1985,22 @@ Value* TransformStep::transformCallVectFunction(CallInst* inst) {
     }
     desired_vfabi.mangled_name = desired_vfabi.toString();
 
+    MathAccuracy accuracy = vf_info.getMathAccuracy();
     FunctionResolution resolution =
-        vf_info.vm_info.function_resolver.get(f, desired_vfabi);
+        vf_info.vm_info.function_resolver.get(f, desired_vfabi, accuracy);
+    if (!resolution.function && vf_info.vm_info.module_vectorizer) {
+        resolution = vf_info.vm_info.module_vectorizer->cloneCalledFunction(
+            f, desired_vfabi, accuracy, vf_info.VF);
+    }
     if (!resolution.function) {
         return nullptr;
     }
     PRINT_HIGH("Resolution is " << resolution.function->getName());
+    if (resolution.is_clone) {
+        vf_info.diagnostics.cloned_called_functions.insert(
+            f->getName().str() + " -> " +
+            resolution.function->getName().str());
+    }
 
     // Call directly, possibly adjusting parameters, lanes, etc.
     VFABI& result_vfabi = resolution.vfabi;
@@ -1271,16 +2168,17 @@ Value* TransformStep::transformPHISecondPass(PHINode* inst) {
 }
 
 Value* TransformStep::transformAlloca(AllocaInst* inst) {
-    // TODO: struct layout optimizations
     PRINT_HIGH("Original alloca instruction is " << *inst);
 
-    if (inst->getAllocatedType()->isStructTy()) {
-        vf_info.diagnostics.unoptimized_allocas.push_back(valueString(inst));
-    }
-
     if (value_cache.getArrayLayoutOpt(inst)) {
         return transformInstructionWithoutVectorizing(inst);
     }
+
+    // struct allocas whose layout can't be changed, see
+    // ShapesStep::analyzeUses
+    if (inst->getAllocatedType()->isStructTy()) {
+        vf_info.diagnostics.unoptimized_allocas.push_back(valueString(inst));
+    }
     // Allocate 'num_lanes' elements
     ConstantInt* orig_num_elements = cast<ConstantInt>(inst->getArraySize());
     APInt new_num_elements_int = orig_num_elements->getValue() * num_lanes;
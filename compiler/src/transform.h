@@ -10,10 +10,12 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
 
 #include "shape.h"
 #include "vectorize.h"
@@ -43,6 +45,8 @@ class TransformStep {
     ValueCache& value_cache;
     unsigned num_lanes;
     std::unordered_set<llvm::Instruction*> display_warnings;
+    // wide load of each interleaved load group, by group leader
+    std::unordered_map<llvm::Instruction*, llvm::Value*> interleaved_loads;
     static std::unordered_set<std::string> already_warned;
 
     llvm::Value* transformInstruction(llvm::Instruction* inst);
@@ -57,6 +61,11 @@ class TransformStep {
     llvm::Value* transformCallPsimApi(llvm::CallInst* inst);
     llvm::Value* transformCallIntrinsic(llvm::CallInst* inst);
     llvm::Value* transformCallVmath(llvm::CallInst* inst);
+    llvm::Value* createSleefCall(llvm::IRBuilder<>& builder,
+                                 std::string sleef_func_name,
+                                 llvm::Type* scalar_ty,
+                                 llvm::ArrayRef<llvm::Value*> args,
+                                 const llvm::Twine& name);
     llvm::Value* transformCallVectFunction(llvm::CallInst* inst);
 
     llvm::Value* transformLoad(llvm::LoadInst* inst);
@@ -71,13 +80,38 @@ class TransformStep {
     llvm::Value* vectorizeMemInst(llvm::Instruction* inst, bool packed,
                                   std::vector<int> indices = {},
                                   size_t esize = 0);
+    llvm::Value* vectorizeInterleavedMemInst(
+        llvm::Instruction* inst, MemInstMappedShape& minst_shape);
 
+    bool hasFullActiveMask(llvm::BasicBlock* BB);
+    void emitPrefetches(llvm::Instruction* inst,
+                        MemInstMappedShape& minst_shape);
+    void markNontemporalStores(llvm::Value* ptr);
     llvm::Value* generateMaskForMemInst(llvm::Instruction* inst,
                                         std::vector<int> indices = {},
                                         unsigned factor = 1);
     void rebaseMemPackedIndices(std::vector<int>& indices, int& min_index,
                                 unsigned& factor);
 
+    /* Gang-wide reductions and scans */
+    enum ReduceOp { REDUCE_ADD, REDUCE_MIN, REDUCE_MAX, REDUCE_AND, REDUCE_OR };
+    ReduceOp getReduceOp(FunctionResolver::PsimApiEnum api_enum);
+    bool isSignedApiCall(llvm::CallInst* inst,
+                         FunctionResolver::PsimApiEnum api_enum);
+    llvm::Constant* getReduceIdentity(ReduceOp op, llvm::Type* ty,
+                                      bool is_signed);
+    llvm::Value* createReduceOp(llvm::IRBuilder<>& builder, ReduceOp op,
+                                bool is_signed, llvm::Value* a, llvm::Value* b,
+                                const llvm::Twine& name);
+    llvm::Value* createGangScan(llvm::IRBuilder<>& builder, ReduceOp op,
+                                bool is_signed, llvm::Value* a,
+                                llvm::Constant* identity,
+                                const llvm::Twine& name);
+
+    llvm::Value* createVariableShuffle(llvm::IRBuilder<>& builder,
+                                       llvm::Value* table, llvm::Value* idx,
+                                       const llvm::Twine& name);
+
     llvm::SmallVector<llvm::Value*> generateArgsForIntrinsics(
         llvm::CallInst* inst);
 
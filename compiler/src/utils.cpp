@@ -118,4 +118,26 @@ std::string getDebugLocStr(Instruction* inst, int leading_zeros) {
     return str;
 }
 
+const char* getMathAccuracyName(MathAccuracy accuracy) {
+    switch (accuracy) {
+        case MATH_PRECISE:
+            return "precise";
+        case MATH_FAST:
+            return "fast";
+        case MATH_APPROX:
+            return "approx";
+    }
+    return "";
+}
+
+bool parseMathAccuracy(StringRef name, MathAccuracy& accuracy) {
+    for (MathAccuracy a : {MATH_PRECISE, MATH_FAST, MATH_APPROX}) {
+        if (name == getMathAccuracyName(a)) {
+            accuracy = a;
+            return true;
+        }
+    }
+    return false;
+}
+
 }  // namespace ps
@@ -11,6 +11,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <llvm/Demangle/Demangle.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Value.h>
@@ -56,11 +59,25 @@
 
 namespace ps {
 
+// accuracy of the vector math functions, see TransformStep::transformCallVmath
+enum MathAccuracy { MATH_PRECISE, MATH_FAST, MATH_APPROX };
+
 typedef struct global_opts_t {
     bool add_prints;
     bool error_on_warn;
     bool ignore_warn_set;
     int scalable_size;
+    unsigned num_jobs;
+    bool versioning;
+    // vectorize clones of the called functions with a visible body
+    bool clone_called_functions;
+    unsigned boscc_threshold;
+    // default distance in gangs of the prefetches of the entry points
+    unsigned prefetch_distance;
+    // default accuracy of the vector math functions of the entry points
+    MathAccuracy math_accuracy;
+    // VFABI isa letters the entry points are vectorized for (see --isa)
+    std::vector<std::string> isas;
 } global_opts_t;
 
 extern global_opts_t global_opts;
@@ -104,4 +121,6 @@ llvm::Type* vectorizeType(llvm::Type* ty, unsigned num_lanes);
 llvm::ElementCount getElementCount(unsigned num_lanes);
 std::vector<uint64_t> getValuesFromGlobalConstant(llvm::Value* value);
 std::string getDebugLocStr(llvm::Instruction* inst, int leading_zeros = 0);
+const char* getMathAccuracyName(MathAccuracy accuracy);
+bool parseMathAccuracy(llvm::StringRef name, MathAccuracy& accuracy);
 }  // namespace ps
@@ -51,6 +51,35 @@ Value* VectorizedFunctionInfo::getLaneID(int stride) {
     return createStrideConstant(ConstantInt::get(i32, 0), num_lanes, stride);
 }
 
+/* Distance in gangs of the prefetches of the loads of an entry point: the one
+ * set by the prefetch(N) clause of the region, or --prefetch-distance */
+unsigned VectorizedFunctionInfo::getPrefetchDistance() {
+    if (!vfabi.is_entry_point) {
+        return 0;
+    }
+    Attribute attr = VF->getFnAttribute("psim-prefetch-distance");
+    unsigned distance;
+    if (attr.isStringAttribute() &&
+        !attr.getValueAsString().getAsInteger(10, distance)) {
+        return distance;
+    }
+    return global_opts.prefetch_distance;
+}
+
+/* Accuracy of the vector math functions: the one set by the math(...) clause
+ * of the region for entry points and for the clones of the functions they
+ * call (see ModuleVectorizer::cloneCalledFunction), or -fmath. Functions
+ * with a vector variant of their own ("declare spmd") use -fmath. */
+MathAccuracy VectorizedFunctionInfo::getMathAccuracy() {
+    Attribute attr = VF->getFnAttribute("psim-math-accuracy");
+    MathAccuracy accuracy;
+    if (attr.isStringAttribute() &&
+        parseMathAccuracy(attr.getValueAsString(), accuracy)) {
+        return accuracy;
+    }
+    return global_opts.math_accuracy;
+}
+
 void VectorizedFunctionInfo::getAnalyses() {
     PB.registerFunctionAnalyses(FAM);
     FPM.run(*VF, FAM);
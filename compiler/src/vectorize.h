@@ -12,6 +12,7 @@
 #pragma once
 
 #include <z3++.h>
+#include <mutex>
 #include <vector>
 
 #include <llvm/IR/BasicBlock.h>
@@ -33,6 +34,7 @@ namespace ps {
 extern unsigned vectorize_verbosity_level;
 
 struct VectorizedModuleInfo;
+class ModuleVectorizer;
 
 struct VectorizedFunctionInfo {
     VectorizedFunctionInfo(VectorizedModuleInfo& vm_info, llvm::Function* VF,
@@ -90,6 +92,8 @@ struct VectorizedFunctionInfo {
                                   bool* is_inverted = nullptr);
     llvm::BasicBlock* getPHIBackedge(llvm::PHINode* inst);
     llvm::Value* getLaneID(int stride = 1);
+    unsigned getPrefetchDistance();
+    MathAccuracy getMathAccuracy();
 
     // z3 context, for shape analysis
     z3::context z3_ctx;
@@ -105,10 +109,32 @@ struct VectorizedFunctionInfo {
 
         std::set<std::string> scalarized_called_functions;
 
+        // vector variants cloned for the calls of the function
+        std::set<std::string> cloned_called_functions;
+
         std::vector<std::string> function_pointer_calls;
 
         std::vector<std::string> unoptimized_allocas;
+
+        // "<libm function> -> <vector function>"
+        std::set<std::string> vmath_functions;
     } diagnostics;
+
+    // Runtime versioning (see ModuleVectorizer::versionFunction)
+    // A uniform integer value known at function entry: either an argument, or
+    // a value loaded from an argument before anything is written to memory
+    struct VersionedValue {
+        unsigned arg;
+        llvm::Type* load_type;  // nullptr for the argument itself
+
+        bool operator==(const VersionedValue& other) const {
+            return arg == other.arg && load_type == other.load_type;
+        }
+    };
+    // values feeding the address of a gather or scatter
+    std::vector<VersionedValue> version_candidates;
+    // values assumed to be 1 in a versioned clone
+    std::vector<VersionedValue> version_assumptions;
 };
 
 typedef std::unordered_map<llvm::Function*,
@@ -122,6 +148,34 @@ struct VectorizedModuleInfo {
     llvm::Module* mod;
     VFInfoMap vfinfo_map;
     FunctionResolver function_resolver;
+    // vectorizes clones of the called functions without a vector variant
+    // (see ModuleVectorizer::cloneCalledFunction)
+    ModuleVectorizer* module_vectorizer = nullptr;
+
+    // The LLVM context is not thread-safe: when functions are vectorized
+    // concurrently (psv -j), each thread holds llvm_mutex while it vectorizes
+    // and only releases it around work that does not touch LLVM (z3 queries)
+    std::mutex llvm_mutex;
+    bool concurrent = false;
+};
+
+// Releases the module lock for the lifetime of the guard when functions are
+// vectorized concurrently
+class ModuleUnlockGuard {
+  public:
+    ModuleUnlockGuard(VectorizedModuleInfo& vm_info) : vm_info(vm_info) {
+        if (vm_info.concurrent) {
+            vm_info.llvm_mutex.unlock();
+        }
+    }
+    ~ModuleUnlockGuard() {
+        if (vm_info.concurrent) {
+            vm_info.llvm_mutex.lock();
+        }
+    }
+
+  private:
+    VectorizedModuleInfo& vm_info;
 };
 
 }  // namespace ps
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#include "vmath.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Intrinsics.h>
+
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+using namespace llvm;
+
+namespace ps {
+
+// supported functions, their number of arguments, and whether they are
+// within 4 ULP of libm over their whole domain. sinf/cosf/tanf lose accuracy
+// near their zeros and above 8192 in magnitude, and the error of powf grows
+// with |log2(result)|, so they are not.
+static const std::unordered_map<std::string, std::pair<unsigned, bool>>
+    vmath_fallback_funcs = {
+        {"expf", {1, true}},   {"exp2f", {1, true}},  {"logf", {1, true}},
+        {"log2f", {1, true}},  {"log10f", {1, true}}, {"powf", {2, false}},
+        {"sinf", {1, false}},  {"cosf", {1, false}},  {"tanf", {1, false}},
+        {"asinf", {1, true}},  {"acosf", {1, true}},  {"atanf", {1, true}},
+        {"atan2f", {2, true}}, {"sinhf", {1, true}},  {"coshf", {1, true}},
+        {"tanhf", {1, true}},
+};
+
+namespace {
+
+class VmathEmitter {
+  public:
+    VmathEmitter(IRBuilder<>& builder, Type* ty, bool approx)
+        : b(builder),
+          approx(approx),
+          ty(ty),
+          ity(ty->isVectorTy() ? (Type*)VectorType::getInteger(
+                                     cast<VectorType>(ty))
+                               : (Type*)builder.getInt32Ty()) {}
+
+    Value* exp(Value* x) {
+        // e^x = 2^n * e^r, with n = round(x / ln(2))
+        Value* xc = clamp(x, -104.0, 89.0);
+        Value* nf = rint(b.CreateFMul(xc, fp(1.44269504088896341)));
+        Value* r = b.CreateFSub(xc, b.CreateFMul(nf, fp(0.693359375)));
+        r = b.CreateFAdd(r, b.CreateFMul(nf, fp(2.12194440e-4)));
+        return passNaN(x, expReduced(nf, r));
+    }
+
+    Value* exp2(Value* x) {
+        Value* xc = clamp(x, -151.0, 129.0);
+        Value* nf = rint(xc);
+        Value* r = b.CreateFMul(b.CreateFSub(xc, nf), fp(0.693147180559945309));
+        return passNaN(x, expReduced(nf, r));
+    }
+
+    Value* log(Value* x) {
+        auto [t, ef] = logReduced(x);
+        Value* ret = b.CreateFAdd(t, b.CreateFMul(ef, fp(-2.12194440e-4)));
+        ret = b.CreateFAdd(ret, b.CreateFMul(ef, fp(0.693359375)));
+        return logSpecialCases(x, ret);
+    }
+
+    Value* log2(Value* x) {
+        auto [t, ef] = logReduced(x);
+        Value* ret = b.CreateFMul(t, fp(1.44269504088896341));
+        return logSpecialCases(x, b.CreateFAdd(ret, ef));
+    }
+
+    Value* log10(Value* x) {
+        auto [t, ef] = logReduced(x);
+        Value* ret = b.CreateFMul(t, fp(0.434294481903251828));
+        ret = b.CreateFAdd(ret, b.CreateFMul(ef, fp(0.301029995663981195)));
+        return logSpecialCases(x, ret);
+    }
+
+    Value* pow(Value* x, Value* y) {
+        // |x|^y = 2^(y * log2(|x|))
+        Value* ax = fabs(x);
+        auto [t, ef] = logReduced(ax);
+        Value* w = b.CreateFMul(y, ef);
+        w = b.CreateFAdd(
+            w, b.CreateFMul(y, b.CreateFMul(t, fp(1.44269504088896341))));
+        Value* mag = exp2(w);
+        Value* y_neg = b.CreateFCmpOLT(y, fp(0.0));
+        Value* ay = fabs(y);
+        if (!approx) {
+            mag = b.CreateSelect(b.CreateFCmpOEQ(ax, fp(0.0)),
+                                 b.CreateSelect(y_neg, inf(), fp(0.0)), mag);
+            mag = b.CreateSelect(b.CreateFCmpOEQ(ax, inf()),
+                                 b.CreateSelect(y_neg, fp(0.0), inf()), mag);
+            Value* ax_lt_one = b.CreateFCmpOLT(ax, fp(1.0));
+            mag = b.CreateSelect(
+                b.CreateFCmpOEQ(ay, inf()),
+                b.CreateSelect(b.CreateICmpEQ(ax_lt_one, y_neg), inf(),
+                               fp(0.0)),
+                mag);
+        }
+
+        // the sign for negative x depends on the parity of y; all the floats
+        // larger than 2^23 are integers, and the ones larger than 2^24 even
+        Value* y_int = b.CreateOr(
+            b.CreateFCmpOGE(ay, fp(8388608.0)),
+            b.CreateFCmpOEQ(rint(clampSmall(y, 8388608.0)), y));
+        Value* y_bits = b.CreateFPToSI(clampSmall(y, 16777216.0), ity);
+        Value* y_odd = b.CreateAnd(
+            y_int,
+            b.CreateICmpNE(b.CreateAnd(y_bits, i32(1)), i32(0)));
+        Value* ret = b.CreateSelect(b.CreateAnd(signBit(x), y_odd),
+                                    b.CreateFNeg(mag), mag);
+        Value* x_neg = b.CreateAnd(b.CreateFCmpOLT(x, fp(0.0)),
+                                   b.CreateFCmpONE(ax, inf()));
+        ret = b.CreateSelect(b.CreateAnd(x_neg, b.CreateNot(y_int)), nan(),
+                             ret);
+        if (approx) {
+            return ret;
+        }
+        ret = b.CreateSelect(b.CreateOr(isNaN(x), isNaN(y)), nan(), ret);
+
+        Value* one = b.CreateOr(b.CreateFCmpOEQ(y, fp(0.0)),
+                                b.CreateFCmpOEQ(x, fp(1.0)));
+        one = b.CreateOr(one, b.CreateAnd(b.CreateFCmpOEQ(x, fp(-1.0)),
+                                          b.CreateFCmpOEQ(ay, inf())));
+        return b.CreateSelect(one, fp(1.0), ret);
+    }
+
+    Value* sin(Value* x) {
+        auto [q, r] = trigReduced(x);
+        auto [s, c] = sinCosReduced(r);
+        return quadrantSelect(q, s, c);
+    }
+
+    Value* cos(Value* x) {
+        auto [q, r] = trigReduced(x);
+        auto [s, c] = sinCosReduced(r);
+        return quadrantSelect(b.CreateAdd(q, i32(1)), s, c);
+    }
+
+    Value* tan(Value* x) {
+        auto [q, r] = trigReduced(x);
+        Value* z = b.CreateFMul(r, r);
+        Value* t = approx ? poly(z, {9.215026840385376E-2,
+                                     1.1806748704390452E-1,
+                                     3.3496143888427166E-1})
+                          : poly(z, {9.38540185543E-3, 3.11992232697E-3,
+                                     2.44301354525E-2, 5.34112807005E-2,
+                                     1.33387994085E-1, 3.33331568548E-1});
+        t = b.CreateFAdd(b.CreateFMul(b.CreateFMul(t, z), r), r);
+        Value* odd = b.CreateICmpNE(b.CreateAnd(q, i32(1)), i32(0));
+        return b.CreateSelect(odd, b.CreateFDiv(fp(-1.0), t), t);
+    }
+
+    Value* asin(Value* x) { return atan2(x, sqrtOneMinusSquare(x)); }
+
+    Value* acos(Value* x) { return atan2(sqrtOneMinusSquare(x), x); }
+
+    Value* atan(Value* x) {
+        // reduce |x| to [0, tan(pi/8)]
+        Value* ax = fabs(x);
+        Value* big = b.CreateFCmpOGT(ax, fp(2.414213562373095));
+        Value* mid = b.CreateFCmpOGT(ax, fp(0.4142135623730950));
+        Value* xr = b.CreateSelect(
+            mid,
+            b.CreateFDiv(b.CreateFSub(ax, fp(1.0)), b.CreateFAdd(ax, fp(1.0))),
+            ax);
+        xr = b.CreateSelect(big, b.CreateFDiv(fp(-1.0), ax), xr);
+        Value* y0 = b.CreateSelect(mid, fp(0.785398163397448310), fp(0.0));
+        y0 = b.CreateSelect(big, fp(1.57079632679489662), y0);
+
+        Value* z = b.CreateFMul(xr, xr);
+        Value* p = approx ? poly(z, {1.7034165202272863E-1,
+                                     -3.3183375687688593E-1})
+                          : poly(z, {8.05374449538e-2, -1.38776856032E-1,
+                                     1.99777106478E-1, -3.33329491539E-1});
+        Value* ret = b.CreateFAdd(b.CreateFMul(b.CreateFMul(p, z), xr), xr);
+        return copysign(b.CreateFAdd(ret, y0), x);
+    }
+
+    Value* atan2(Value* y, Value* x) {
+        Value* pi = fp(3.14159265358979324);
+        Value* ret = atan(b.CreateFDiv(y, x));
+        ret = b.CreateSelect(b.CreateFCmpOLT(x, fp(0.0)),
+                             b.CreateFAdd(ret, copysign(pi, y)), ret);
+
+        if (!approx) {
+            Value* inf_x = b.CreateFCmpOEQ(fabs(x), inf());
+            Value* inf_y = b.CreateFCmpOEQ(fabs(y), inf());
+            Value* inf_ret = b.CreateSelect(b.CreateFCmpOGT(x, fp(0.0)),
+                                            fp(0.785398163397448310),
+                                            fp(2.35619449019234492));
+            ret = b.CreateSelect(b.CreateAnd(inf_x, inf_y),
+                                 copysign(inf_ret, y), ret);
+        }
+
+        ret = b.CreateSelect(b.CreateFCmpOEQ(x, fp(0.0)),
+                             copysign(fp(1.57079632679489662), y), ret);
+
+        // atan2(+-0, x) is +-pi for x < 0 or x = -0, and +-0 otherwise
+        Value* zero_ret = b.CreateSelect(signBit(x), pi, fp(0.0));
+        ret = b.CreateSelect(b.CreateFCmpOEQ(y, fp(0.0)),
+                             copysign(zero_ret, y), ret);
+        if (approx) {
+            return ret;
+        }
+        return b.CreateSelect(b.CreateOr(isNaN(x), isNaN(y)),
+                              b.CreateFAdd(x, y), ret);
+    }
+
+    Value* sinh(Value* x) {
+        Value* ax = fabs(x);
+        Value* z = b.CreateFMul(x, x);
+        Value* p =
+            poly(z, {2.03721912945E-4, 8.33028376239E-3, 1.66667160211E-1});
+        Value* small = b.CreateFAdd(b.CreateFMul(b.CreateFMul(p, z), x), x);
+        Value* e = halfExp(ax);
+        Value* big = b.CreateFSub(e, b.CreateFDiv(fp(0.25), e));
+        return b.CreateSelect(b.CreateFCmpOLT(ax, fp(1.0)), small,
+                              copysign(big, x));
+    }
+
+    Value* cosh(Value* x) {
+        Value* e = halfExp(fabs(x));
+        return b.CreateFAdd(e, b.CreateFDiv(fp(0.25), e));
+    }
+
+    Value* tanh(Value* x) {
+        Value* ax = fabs(x);
+        Value* z = b.CreateFMul(x, x);
+        Value* p = poly(z, {-5.70498872745E-3, 2.06390887954E-2,
+                            -5.37397155531E-2, 1.33314422036E-1,
+                            -3.33332819422E-1});
+        Value* small = b.CreateFAdd(b.CreateFMul(b.CreateFMul(p, z), x), x);
+        // 1 - 2 / (e^2|x| + 1)
+        Value* e = exp(b.CreateFAdd(ax, ax));
+        Value* big = b.CreateFSub(
+            fp(1.0), b.CreateFDiv(fp(2.0), b.CreateFAdd(e, fp(1.0))));
+        return b.CreateSelect(b.CreateFCmpOLT(ax, fp(0.625)), small,
+                              copysign(big, x));
+    }
+
+  private:
+    IRBuilder<>& b;
+    // shorter polynomials, and no handling of the special cases
+    bool approx;
+    Type* ty;
+    Type* ity;
+
+    Value* fp(double v) { return ConstantFP::get(ty, v); }
+    Value* i32(int64_t v) { return ConstantInt::get(ity, v); }
+    Value* inf() { return ConstantFP::getInfinity(ty); }
+    Value* nan() { return ConstantFP::getNaN(ty); }
+    Value* isNaN(Value* x) { return b.CreateFCmpUNO(x, x); }
+
+    // returns x where it is NaN, ret elsewhere
+    Value* passNaN(Value* x, Value* ret) {
+        return approx ? ret : b.CreateSelect(isNaN(x), x, ret);
+    }
+
+    Value* signBit(Value* x) {
+        return b.CreateICmpSLT(b.CreateBitCast(x, ity), i32(0));
+    }
+
+    Value* fabs(Value* x) { return b.CreateUnaryIntrinsic(Intrinsic::fabs, x); }
+
+    Value* copysign(Value* mag, Value* sign) {
+        return b.CreateBinaryIntrinsic(Intrinsic::copysign, mag, sign);
+    }
+
+    // Horner evaluation, from the highest degree coefficient
+    Value* poly(Value* x, std::initializer_list<double> coeffs) {
+        Value* ret = nullptr;
+        for (double c : coeffs) {
+            ret = ret ? b.CreateFAdd(b.CreateFMul(ret, x), fp(c)) : fp(c);
+        }
+        return ret;
+    }
+
+    // NaN is replaced by 0, so that it can be converted to an integer
+    Value* clamp(Value* x, double lo, double hi) {
+        Value* ret = b.CreateSelect(b.CreateFCmpOGT(x, fp(hi)), fp(hi), x);
+        ret = b.CreateSelect(b.CreateFCmpOLT(x, fp(lo)), fp(lo), ret);
+        return b.CreateSelect(isNaN(x), fp(0.0), ret);
+    }
+
+    // x if |x| < limit, else 0
+    Value* clampSmall(Value* x, double limit) {
+        return b.CreateSelect(b.CreateFCmpOLT(fabs(x), fp(limit)), x,
+                              fp(0.0));
+    }
+
+    // round to nearest even, for |x| < 2^23
+    Value* rint(Value* x) {
+        Value* magic = fp(8388608.0);
+        Value* ret = b.CreateFSub(b.CreateFAdd(fabs(x), magic), magic);
+        return copysign(ret, x);
+    }
+
+    // 2^n, for -126 <= n <= 127
+    Value* pow2i(Value* n) {
+        Value* bits = b.CreateShl(b.CreateAdd(n, i32(127)), i32(23));
+        return b.CreateBitCast(bits, ty);
+    }
+
+    // 2^nf * e^r, for an integer -151 <= nf <= 129 and |r| <= ln(2) / 2
+    Value* expReduced(Value* nf, Value* r) {
+        Value* p = approx ? poly(r, {4.127764078226033E-2,
+                                     1.6753528923216318E-1,
+                                     5.000511816936108E-1})
+                          : poly(r, {1.9875691500E-4, 1.3981999507E-3,
+                                     8.3334519073E-3, 4.1665795894E-2,
+                                     1.6666665459E-1, 5.0000001201E-1});
+        p = b.CreateFMul(p, b.CreateFMul(r, r));
+        p = b.CreateFAdd(b.CreateFAdd(p, r), fp(1.0));
+
+        // scale in two steps, so that the result can be subnormal or inf
+        Value* n = b.CreateFPToSI(nf, ity);
+        Value* n1 = b.CreateAShr(n, i32(1));
+        Value* n2 = b.CreateSub(n, n1);
+        return b.CreateFMul(b.CreateFMul(p, pow2i(n1)), pow2i(n2));
+    }
+
+    // e^x / 2, for x >= 1: x - 0.693359375 is exact, unlike x - ln(2)
+    Value* halfExp(Value* x) {
+        Value* e = exp(b.CreateFSub(x, fp(0.693359375)));
+        return b.CreateFMul(e, fp(1.00021221695488754));
+    }
+
+    // {t, e} with ln(x) = t + e * ln(2), for finite x > 0
+    std::pair<Value*, Value*> logReduced(Value* x) {
+        // subnormals are scaled by 2^23 first
+        Value* subnormal = b.CreateFCmpOLT(x, fp(1.17549435e-38));
+        Value* xs = x;
+        if (!approx) {
+            xs = b.CreateSelect(subnormal, b.CreateFMul(x, fp(8388608.0)), x);
+        }
+        Value* bits = b.CreateBitCast(xs, ity);
+
+        // x = m * 2^e, with m in [sqrt(2)/2, sqrt(2))
+        Value* e = b.CreateAnd(b.CreateLShr(bits, i32(23)), i32(0xff));
+        e = b.CreateSub(e, i32(126));
+        if (!approx) {
+            e = b.CreateSelect(subnormal, b.CreateSub(e, i32(23)), e);
+        }
+        Value* m_bits = b.CreateOr(b.CreateAnd(bits, i32(0x807fffff)),
+                                   i32(0x3f000000));
+        Value* m = b.CreateBitCast(m_bits, ty);
+        Value* lt = b.CreateFCmpOLT(m, fp(0.707106781186547524));
+        e = b.CreateSelect(lt, b.CreateSub(e, i32(1)), e);
+        m = b.CreateSelect(lt, b.CreateFAdd(m, m), m);
+        m = b.CreateFSub(m, fp(1.0));
+
+        Value* z = b.CreateFMul(m, m);
+        Value* p = approx ? poly(m, {-1.4591827701168034E-1,
+                                     2.1776364589037867E-1,
+                                     -2.524505677140398E-1,
+                                     3.3285477272761416E-1})
+                          : poly(m, {7.0376836292E-2, -1.1514610310E-1,
+                                     1.1676998740E-1, -1.2420140846E-1,
+                                     1.4249322787E-1, -1.6668057665E-1,
+                                     2.0000714765E-1, -2.4999993993E-1,
+                                     3.3333331174E-1});
+        Value* y = b.CreateFMul(b.CreateFMul(m, z), p);
+        y = b.CreateFSub(y, b.CreateFMul(z, fp(0.5)));
+        return {b.CreateFAdd(m, y), b.CreateSIToFP(e, ty)};
+    }
+
+    Value* logSpecialCases(Value* x, Value* ret) {
+        if (approx) {
+            return ret;
+        }
+        ret = b.CreateSelect(b.CreateFCmpOEQ(x, inf()), inf(), ret);
+        ret = b.CreateSelect(b.CreateFCmpOEQ(x, fp(0.0)),
+                             ConstantFP::getInfinity(ty, true), ret);
+        return b.CreateSelect(
+            b.CreateOr(b.CreateFCmpOLT(x, fp(0.0)), isNaN(x)), nan(), ret);
+    }
+
+    // {q, r} with x = q * pi/2 + r and |r| <= pi/4
+    std::pair<Value*, Value*> trigReduced(Value* x) {
+        Value* j = b.CreateFMul(x, fp(0.636619772367581343));
+        // the reduction is meaningless for |x| >= 2^23 * pi/2, where r is
+        // set to 0
+        Value* small = b.CreateFCmpOLT(fabs(j), fp(8388608.0));
+        Value* nf = rint(clampSmall(j, 8388608.0));
+        Value* q = b.CreateFPToSI(nf, ity);
+
+        // Cody-Waite reduction with pi/2 split in three parts
+        Value* r = b.CreateFSub(x, b.CreateFMul(nf, fp(1.5703125)));
+        r = b.CreateFSub(r, b.CreateFMul(nf, fp(4.837512969970703125e-4)));
+        r = b.CreateFSub(r, b.CreateFMul(nf, fp(7.54978995489188216e-8)));
+        if (!approx) {
+            r = b.CreateSelect(small, r, fp(0.0));
+            r = b.CreateSelect(b.CreateFCmpOLT(fabs(x), inf()), r, nan());
+        }
+        return {q, r};
+    }
+
+    std::pair<Value*, Value*> sinCosReduced(Value* r) {
+        Value* z = b.CreateFMul(r, r);
+        Value* ps = approx ? poly(z, {8.163282464484568E-3,
+                                      -1.666339040465781E-1})
+                           : poly(z, {-1.9515295891E-4, 8.3321608736E-3,
+                                      -1.6666654611E-1});
+        Value* s = b.CreateFAdd(b.CreateFMul(b.CreateFMul(ps, z), r), r);
+        Value* pc = approx ? fp(4.089929588343733E-2)
+                           : poly(z, {2.443315711809948E-5,
+                                      -1.388731625493765E-3,
+                                      4.166664568298827E-2});
+        Value* c = b.CreateFMul(b.CreateFMul(pc, z), z);
+        c = b.CreateFSub(c, b.CreateFMul(z, fp(0.5)));
+        return {s, b.CreateFAdd(c, fp(1.0))};
+    }
+
+    // sin(q * pi/2 + r) from sin(r) and cos(r)
+    Value* quadrantSelect(Value* q, Value* s, Value* c) {
+        Value* odd = b.CreateICmpNE(b.CreateAnd(q, i32(1)), i32(0));
+        Value* neg = b.CreateICmpNE(b.CreateAnd(q, i32(2)), i32(0));
+        Value* ret = b.CreateSelect(odd, c, s);
+        return b.CreateSelect(neg, b.CreateFNeg(ret), ret);
+    }
+
+    Value* sqrtOneMinusSquare(Value* x) {
+        Value* v = b.CreateFMul(b.CreateFSub(fp(1.0), x),
+                                b.CreateFAdd(fp(1.0), x));
+        return b.CreateUnaryIntrinsic(Intrinsic::sqrt, v);
+    }
+};
+
+}  // namespace
+
+bool hasVmathFallback(StringRef name, bool precise) {
+    auto it = vmath_fallback_funcs.find(name.str());
+    return it != vmath_fallback_funcs.end() &&
+           (!precise || it->second.second);
+}
+
+Value* createVmathFallback(IRBuilder<>& builder, StringRef name,
+                           ArrayRef<Value*> args, bool approx) {
+    auto it = vmath_fallback_funcs.find(name.str());
+    if (it == vmath_fallback_funcs.end() || it->second.first != args.size()) {
+        return nullptr;
+    }
+    for (Value* arg : args) {
+        if (!arg->getType()->getScalarType()->isFloatTy()) {
+            return nullptr;
+        }
+    }
+
+    VmathEmitter e(builder, args[0]->getType(), approx);
+    if (name == "expf") return e.exp(args[0]);
+    if (name == "exp2f") return e.exp2(args[0]);
+    if (name == "logf") return e.log(args[0]);
+    if (name == "log2f") return e.log2(args[0]);
+    if (name == "log10f") return e.log10(args[0]);
+    if (name == "powf") return e.pow(args[0], args[1]);
+    if (name == "sinf") return e.sin(args[0]);
+    if (name == "cosf") return e.cos(args[0]);
+    if (name == "tanf") return e.tan(args[0]);
+    if (name == "asinf") return e.asin(args[0]);
+    if (name == "acosf") return e.acos(args[0]);
+    if (name == "atanf") return e.atan(args[0]);
+    if (name == "atan2f") return e.atan2(args[0], args[1]);
+    if (name == "sinhf") return e.sinh(args[0]);
+    if (name == "coshf") return e.cosh(args[0]);
+    if (name == "tanhf") return e.tanh(args[0]);
+    return nullptr;
+}
+
+}  // namespace ps
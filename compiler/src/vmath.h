@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Value.h>
+
+namespace ps {
+
+/* In-tree vector math library.
+ *
+ * The single precision libm functions listed in vmath.cpp are emitted inline
+ * as vector IR: a range reduction with integer and select operations, and
+ * the polynomial approximations of the Cephes library. They are used for the
+ * calls that no vector math library (Sleef) handles, so that transcendental
+ * functions are not scalarized lane by lane.
+ *
+ * The results are within 4 ULP of libm, except for sinf/cosf/tanf near their
+ * zeros and for arguments larger than 8192 in magnitude, and for powf, whose
+ * error grows with |log2(result)| up to about 100 ULP near the limits of the
+ * float range. These four are only used with math(fast) and math(approx):
+ * with 'precise', hasVmathFallback is false for them and they are scalarized.
+ *
+ * With 'approx' (math(approx)), lower degree minimax polynomials are used
+ * and the special cases (NaN, infinities, subnormals, zeros of log, huge
+ * trigonometric arguments) are not handled; the relative error is below
+ * 5e-5 for finite arguments and normal results.
+ */
+bool hasVmathFallback(llvm::StringRef name, bool precise);
+
+// 'args' are vectors of float; returns nullptr if 'name' is not supported
+llvm::Value* createVmathFallback(llvm::IRBuilder<>& builder,
+                                 llvm::StringRef name,
+                                 llvm::ArrayRef<llvm::Value*> args,
+                                 bool approx = false);
+
+}  // namespace ps
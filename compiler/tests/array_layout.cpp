@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define NSTEPS 32
+
+// private array accessed with uniform indices k and k + 1, like the binomial
+// options pricing kernel: the element k of all the lanes is a packed access
+int main() {
+    float in[NELEM];
+    float out[NELEM];
+
+    for (int i = 0; i < NELEM; i++) {
+        in[i] = i % 7;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        float V[NSTEPS] = {};
+        for (int j = 0; j < NSTEPS; j++) {
+            V[j] += in[i] + j;
+        }
+        for (int j = NSTEPS - 1; j >= 0; --j) {
+            for (int k = 0; k < j; ++k) {
+                V[k] = (V[k] + V[k + 1]) * 0.5f;
+            }
+        }
+        out[i] = V[0];
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        float V[NSTEPS];
+        for (int j = 0; j < NSTEPS; j++) {
+            V[j] = in[i] + j;
+        }
+        for (int j = NSTEPS - 1; j >= 0; --j) {
+            for (int k = 0; k < j; ++k) {
+                V[k] = (V[k] + V[k + 1]) * 0.5f;
+            }
+        }
+        if (out[i] != V[0]) {
+            printf("Fail! out[%d] = %f, expected %f\n", i, out[i], V[0]);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
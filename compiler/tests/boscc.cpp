@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+
+float a[NELEM];
+float b[NELEM];
+
+static float expected(int i) {
+    float x = a[i];
+    if (x > 100.0f) {
+        for (int j = 0; j < 4; j++) {
+            x = x * 0.5f + (float)j;
+            x = x * x * 0.001f + x;
+        }
+    } else {
+        x = x - 1.0f;
+    }
+    return x;
+}
+
+int main() {
+    // gangs with all lanes taking the 'then' side, gangs with none, and
+    // gangs with some
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = (i / 64) % 3 == 0 ? 200.0f + i
+               : (i / 64) % 3 == 1 ? (float)(i % 50)
+                                   : (float)((i * 37) % 300);
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        float x = a[i];
+        if (x > 100.0f) {
+            for (int j = 0; j < 4; j++) {
+                x = x * 0.5f + (float)j;
+                x = x * x * 0.001f + x;
+            }
+        } else {
+            x = x - 1.0f;
+        }
+        b[i] = x;
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        if (b[i] != expected(i)) {
+            printf("Fail! b[%d] = %f, expected %f\n", i, b[i], expected(i));
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+
+int32_t a[NELEM];
+int32_t b[NELEM];
+int32_t out[NELEM];
+
+int main() {
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = rand() % 1000;
+        b[i] = -1;
+    }
+
+    // write the multiples of 3 contiguously
+    unsigned count = 0;
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        int32_t v = a[i];
+        if (v % 3 == 0) {
+            count += psim_compress_store(out + count, v);
+        }
+    }
+
+    // and read them back to their lanes
+    unsigned count2 = 0;
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        if (a[i] % 3 == 0) {
+            b[i] = psim_expand_load((const int32_t*)out + count2);
+            count2 += psim_compress_store(out + count2, b[i]);
+        }
+    }
+
+    unsigned ref_count = 0;
+    for (int i = 0; i < NELEM; i++) {
+        if (a[i] % 3 == 0) {
+            if (out[ref_count] != a[i] || b[i] != a[i]) {
+                printf("Fail! at %d: %d %d, expected %d\n", i, out[ref_count],
+                       b[i], a[i]);
+                exit(2);
+            }
+            ref_count++;
+        } else if (b[i] != -1) {
+            printf("Fail! b[%d] = %d\n", i, b[i]);
+            exit(2);
+        }
+    }
+    if (count != ref_count || count2 != ref_count) {
+        printf("Fail! count %u %u, expected %u\n", count, count2, ref_count);
+        exit(2);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+// the tail gang must not write past NELEM
+#define NPAD 64
+#define SENTINEL -1
+
+int a[NELEM];
+int perm[NELEM];
+int out1[NELEM + NPAD];
+int out2[NELEM + NPAD];
+int out3[NELEM + NPAD];
+int out4[NELEM + NPAD];
+
+// called under a varying condition: vectorized as a masked clone, in which
+// the uniform branch must keep the mask of the call
+__attribute__((noinline)) static void store_if(int* p, int v, int n) {
+    if (n > 2) {
+        *p = v;
+    }
+}
+
+void check(int* out, int i, int expected) {
+    if (out[i] != expected) {
+        printf("Fail! out[%d] = %d, expected %d\n", i, out[i], expected);
+        exit(2);
+    }
+}
+
+int main(int argc, char** argv) {
+    // uniform, but unknown to psv
+    int n = argc + 2;
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = rand() % 256;
+        perm[i] = (i * 7) % NELEM;
+    }
+    for (int i = 0; i < NELEM + NPAD; i++) {
+        out1[i] = out2[i] = out3[i] = out4[i] = SENTINEL;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        // full active mask in the body gangs, not in the tail gang
+        if (n > 2) {
+            out1[i] = a[i];
+        }
+        if (a[i] & 1) {
+            // uniform branch nested in a varying one
+            if (n > 2) {
+                out2[i] = a[i] + 1;
+                out3[perm[i]] = a[i] + 2;
+            }
+            store_if(&out4[i], a[i] + 3, n);
+        }
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        bool odd = a[i] & 1;
+        check(out1, i, a[i]);
+        check(out2, i, odd ? a[i] + 1 : SENTINEL);
+        check(out3, perm[i], odd ? a[i] + 2 : SENTINEL);
+        check(out4, i, odd ? a[i] + 3 : SENTINEL);
+    }
+    for (int i = NELEM; i < NELEM + NPAD; i++) {
+        check(out1, i, SENTINEL);
+        check(out2, i, SENTINEL);
+        check(out3, i, SENTINEL);
+        check(out4, i, SENTINEL);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+
+// helper functions without a vector variant, vectorized as clones for the
+// shapes of the arguments of their calls
+
+// varying and uniform arguments
+static float __attribute__((noinline)) scale(float x, float factor) {
+    return x * factor + 1.0f;
+}
+
+// linear pointer argument
+static int __attribute__((noinline)) sum3(const int* p) {
+    return p[0] + p[1] + p[2];
+}
+
+// called under a mask, with a loop
+static int __attribute__((noinline)) collatz(int n) {
+    int steps = 0;
+    while (n != 1) {
+        n = n % 2 ? 3 * n + 1 : n / 2;
+        steps++;
+    }
+    return steps;
+}
+
+// recursive
+static int __attribute__((noinline)) digits(int n) {
+    return n < 10 ? 1 : 1 + digits(n / 10);
+}
+
+static int ref_collatz(int n) {
+    int steps = 0;
+    while (n != 1) {
+        n = n % 2 ? 3 * n + 1 : n / 2;
+        steps++;
+    }
+    return steps;
+}
+
+int main() {
+    float a[NELEM];
+    float b[NELEM];
+    int c[NELEM + 2];
+    int d[NELEM];
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = i * 0.5f;
+    }
+    for (int i = 0; i < NELEM + 2; i++) {
+        c[i] = i;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        b[i] = scale(a[i], 2.0f);
+        int r = sum3(&c[i]);
+        if (i % 3 != 0) {
+            r += collatz(i + 1);
+        }
+        d[i] = r + digits(i * 7);
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        float b_ref = a[i] * 2.0f + 1.0f;
+        int d_ref = 3 * i + 3;
+        if (i % 3 != 0) {
+            d_ref += ref_collatz(i + 1);
+        }
+        int n = i * 7;
+        int num_digits = 1;
+        while (n >= 10) {
+            n /= 10;
+            num_digits++;
+        }
+        d_ref += num_digits;
+        if (b[i] != b_ref || d[i] != d_ref) {
+            printf("Fail! i = %d: %f %d, expected %f %d\n", i, b[i], d[i],
+                   b_ref, d_ref);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NPIXELS 1000
+
+uint8_t bgr[NPIXELS * 3];
+uint8_t bgra[NPIXELS * 4];
+uint16_t uv[NPIXELS * 2];
+uint8_t b[NPIXELS];
+uint8_t g[NPIXELS];
+uint8_t r[NPIXELS];
+uint16_t u[NPIXELS];
+
+int main() {
+    for (int i = 0; i < NPIXELS * 3; i++) {
+        bgr[i] = (i * 7) & 0xff;
+    }
+    for (int i = 0; i < NPIXELS * 2; i++) {
+        uv[i] = i * 3;
+    }
+    for (int i = 0; i < NPIXELS * 4; i++) {
+        bgra[i] = 0x55;
+    }
+
+    // stride 3 load group
+#psim num_spmd_threads(NPIXELS) gang_size(32)
+    {
+        uint64_t i = psim_get_thread_num();
+        b[i] = bgr[i * 3 + 0];
+        g[i] = bgr[i * 3 + 1];
+        r[i] = bgr[i * 3 + 2];
+    }
+
+    // stride 4 store group, the alpha channel is a gap
+#psim num_spmd_threads(NPIXELS) gang_size(32)
+    {
+        uint64_t i = psim_get_thread_num();
+        bgra[i * 4 + 0] = b[i];
+        bgra[i * 4 + 1] = g[i];
+        bgra[i * 4 + 2] = r[i];
+    }
+
+    // stride 2 load group and stride 2 store group
+#psim num_spmd_threads(NPIXELS) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        uint16_t x = uv[i * 2 + 1];
+        uint16_t y = uv[i * 2];
+        u[i] = x - y;
+        uv[i * 2] = x;
+        uv[i * 2 + 1] = y;
+    }
+
+    for (int i = 0; i < NPIXELS; i++) {
+        for (int c = 0; c < 3; c++) {
+            uint8_t expected = ((i * 3 + c) * 7) & 0xff;
+            if (bgra[i * 4 + c] != expected) {
+                printf("Fail! bgra[%d] = %d, expected %d\n", i * 4 + c,
+                       bgra[i * 4 + c], expected);
+                exit(2);
+            }
+        }
+        if (bgra[i * 4 + 3] != 0x55) {
+            printf("Fail! bgra[%d] = %d, expected %d\n", i * 4 + 3,
+                   bgra[i * 4 + 3], 0x55);
+            exit(2);
+        }
+        if (u[i] != 3 || uv[i * 2] != (i * 2 + 1) * 3 ||
+            uv[i * 2 + 1] != i * 2 * 3) {
+            printf("Fail! u[%d] = %d, uv = {%d, %d}\n", i, u[i], uv[i * 2],
+                   uv[i * 2 + 1]);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+
+int main() {
+    float* a = (float*)aligned_alloc(64, 1024 * sizeof(float));
+    float* b = (float*)aligned_alloc(64, 1024 * sizeof(float));
+    float* c = (float*)aligned_alloc(64, 1024 * sizeof(float));
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = i;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16) nontemporal(b)
+    {
+        uint64_t i = psim_get_thread_num();
+        b[i] = a[i] * 2.0f;
+    }
+
+#psim parallel num_spmd_threads(NELEM) gang_size(32)
+    {
+        uint64_t i = psim_get_thread_num();
+        psim_store_stream(&c[i], a[i] + b[i]);
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        if (b[i] != i * 2.0f) {
+            printf("Fail! b[%d] = %f, expected %f\n", i, b[i], i * 2.0f);
+            exit(2);
+        }
+        if (c[i] != i * 3.0f) {
+            printf("Fail! c[%d] = %f, expected %f\n", i, c[i], i * 3.0f);
+            exit(2);
+        }
+    }
+
+    free(a);
+    free(b);
+    free(c);
+
+    printf("Success!\n");
+    return 0;
+}
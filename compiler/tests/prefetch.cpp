@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define STRIDE 17
+
+int main() {
+    int* a = (int*)malloc(NELEM * sizeof(int));
+    int* b = (int*)malloc(NELEM * STRIDE * sizeof(int));
+    int* c = (int*)malloc(NELEM * sizeof(int));
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = i;
+        for (int j = 0; j < STRIDE; j++) {
+            b[i * STRIDE + j] = i + j;
+        }
+    }
+
+    // packed and strided (gathered) loads, prefetched 4 gangs ahead
+#psim num_spmd_threads(NELEM) gang_size(16) prefetch(4)
+    {
+        uint64_t i = psim_get_thread_num();
+        c[i] = a[i] + b[i * STRIDE + 1];
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        if (c[i] != 2 * i + 1) {
+            printf("Fail! c[%d] = %d, expected %d\n", i, c[i], 2 * i + 1);
+            exit(2);
+        }
+    }
+
+    free(a);
+    free(b);
+    free(c);
+
+    printf("Success!\n");
+    return 0;
+}
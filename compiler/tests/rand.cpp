@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define NDRAWS 4
+#define SEED 42
+
+int main() {
+    uint64_t a[NELEM];
+    uint32_t b[NELEM];
+    float c[NELEM];
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        PsimRand rng = psim_rand_init(SEED);
+        uint64_t x = 0;
+        for (int j = 0; j < NDRAWS; j++) {
+            x ^= psim_rand_u64(rng);
+        }
+        a[i] = x;
+        b[i] = psim_rand_u32(rng);
+        // draws under varying control flow only advance the active threads
+        if (i % 3 == 0) {
+            psim_rand_u32(rng);
+        }
+        c[i] = psim_rand_float(rng);
+    }
+
+    // the sequence of a thread only depends on the seed and its number
+    for (int i = 0; i < NELEM; i++) {
+        PsimRand rng = psim_rand_init(SEED, i);
+        uint64_t x = 0;
+        for (int j = 0; j < NDRAWS; j++) {
+            x ^= psim_rand_u64(rng);
+        }
+        uint32_t y = psim_rand_u32(rng);
+        if (i % 3 == 0) {
+            psim_rand_u32(rng);
+        }
+        float z = psim_rand_float(rng);
+        if (a[i] != x || b[i] != y || c[i] != z) {
+            printf("Fail! thread %d\n", i);
+            exit(2);
+        }
+        if (c[i] < 0.0f || c[i] >= 1.0f) {
+            printf("Fail! c[%d] = %f out of [0, 1)\n", i, c[i]);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
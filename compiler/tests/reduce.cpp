@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 12345
+
+int32_t a[NELEM];
+uint16_t b[NELEM];
+float c[NELEM];
+
+int main() {
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = rand() % 2001 - 1000;
+        b[i] = rand() % 65536;
+        c[i] = (rand() % 1000) / 7.0f;
+    }
+
+    int64_t ref_sum = 0;
+    int32_t ref_max = INT32_MIN;
+    uint16_t ref_min = UINT16_MAX;
+    uint16_t ref_and = UINT16_MAX;
+    uint16_t ref_or = 0;
+    float ref_fsum = 0.0f;
+    for (int i = 0; i < NELEM; i++) {
+        if (a[i] > 0) {
+            ref_sum += a[i];
+        }
+        ref_max = std::max(ref_max, a[i]);
+        ref_min = std::min(ref_min, b[i]);
+        ref_and &= b[i] | 0x8001;
+        ref_or |= b[i] & 0x0ff0;
+        ref_fsum += c[i];
+    }
+
+    PsimReduceAdd<int64_t> sum;
+    PsimReduceMax<int32_t> max;
+    PsimReduceMin<uint16_t> min;
+    PsimReduceAnd<uint16_t> and_;
+    PsimReduceOr<uint16_t> or_;
+    PsimReduceAdd<float> fsum;
+    PsimReduceAdd<float, true> fsum_reassoc;
+
+#psim num_spmd_threads(NELEM) gang_size(32)
+    {
+        uint64_t i = psim_get_thread_num();
+        if (a[i] > 0) {
+            psim_reduce_add_sync(sum, a[i]);
+        }
+        psim_reduce_max_sync(max, a[i]);
+        psim_reduce_min_sync(min, b[i]);
+        psim_reduce_and_sync(and_, b[i] | 0x8001);
+        psim_reduce_or_sync(or_, b[i] & 0x0ff0);
+        psim_reduce_add_sync(fsum, c[i]);
+        psim_reduce_add_sync(fsum_reassoc, c[i]);
+    }
+
+    if (sum.Reduce() != ref_sum || max.Reduce() != ref_max ||
+        min.Reduce() != ref_min || and_.Reduce() != ref_and ||
+        or_.Reduce() != ref_or) {
+        printf("Fail! integer reductions\n");
+        exit(2);
+    }
+    // without reassociation the lanes are added in order
+    if (fsum.Reduce() != ref_fsum) {
+        printf("Fail! fsum = %f, expected %f\n", fsum.Reduce(), ref_fsum);
+        exit(2);
+    }
+    if (std::fabs(fsum_reassoc.Reduce() - ref_fsum) > 1e-4f * ref_fsum) {
+        printf("Fail! fsum_reassoc = %f, expected %f\n", fsum_reassoc.Reduce(),
+               ref_fsum);
+        exit(2);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
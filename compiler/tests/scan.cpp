@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+#define GANG_SIZE 64
+
+uint8_t a[NELEM];
+uint32_t integral[NELEM];
+uint32_t offsets[NELEM];
+uint8_t running_min[NELEM];
+
+int main() {
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = rand() % 256;
+    }
+
+    PsimScanCarry<uint32_t> sum;
+    PsimScanCarry<uint8_t, PSIM_REDUCE_MIN> min;
+
+#psim num_spmd_threads(NELEM) gang_size(GANG_SIZE)
+    {
+        uint64_t i = psim_get_thread_num();
+        uint32_t v = a[i];
+        // running sum over the whole grid, e.g. one row of an integral image
+        integral[i] = psim_scan_add_sync(sum, v, true);
+        // offsets of the odd values within the gang
+        offsets[i] = psim_scan_add_sync<uint32_t>(v & 1, false);
+        running_min[i] = psim_scan_min_sync(min, a[i], true);
+    }
+
+    uint32_t ref_sum = 0;
+    uint32_t ref_offset = 0;
+    uint8_t ref_min = UINT8_MAX;
+    for (int i = 0; i < NELEM; i++) {
+        if (i % GANG_SIZE == 0) {
+            ref_offset = 0;
+        }
+        ref_sum += a[i];
+        ref_min = a[i] < ref_min ? a[i] : ref_min;
+        if (integral[i] != ref_sum || offsets[i] != ref_offset ||
+            running_min[i] != ref_min) {
+            printf("Fail! at %d: %u %u %u, expected %u %u %u\n", i,
+                   integral[i], offsets[i], running_min[i], ref_sum,
+                   ref_offset, ref_min);
+            exit(2);
+        }
+        ref_offset += a[i] & 1;
+    }
+    if (sum.Get() != ref_sum || min.Get() != ref_min) {
+        printf("Fail! carries\n");
+        exit(2);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+
+int main() {
+    int a[NELEM];
+    int b[NELEM];
+    int c[NELEM];
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = 0;
+        b[i] = 0;
+        c[i] = 0;
+    }
+
+#psim parallel schedule(dynamic, 3) num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        // irregular amount of work per thread
+        int sum = 0;
+        for (uint64_t j = 0; j < i % 37; j++) {
+            sum += j;
+        }
+        a[i] = sum + psim_is_head_gang() + psim_is_tail_gang();
+    }
+
+#psim parallel schedule(guided) num_spmd_gangs(NELEM / 16) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        b[i] = i * 2;
+    }
+
+#psim parallel schedule(static) num_spmd_threads(NELEM) gang_size(32)
+    {
+        uint64_t i = psim_get_thread_num();
+        c[i] = i + 1;
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        int m = i % 37;
+        int expected = m * (m - 1) / 2 + (i < 16) + (i >= (NELEM / 16) * 16);
+        if (a[i] != expected) {
+            printf("Fail! a[%d] = %d, expected %d\n", i, a[i], expected);
+            exit(2);
+        }
+        expected = i < (NELEM / 16) * 16 ? i * 2 : 0;
+        if (b[i] != expected) {
+            printf("Fail! b[%d] = %d, expected %d\n", i, b[i], expected);
+            exit(2);
+        }
+        if (c[i] != i + 1) {
+            printf("Fail! c[%d] = %d, expected %d\n", i, c[i], i + 1);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define GANG_SIZE 64
+
+uint8_t table[2 * GANG_SIZE];
+uint8_t in[GANG_SIZE];
+uint8_t lookup[GANG_SIZE];
+int32_t rev[GANG_SIZE];
+
+int main() {
+    for (int i = 0; i < 2 * GANG_SIZE; i++) {
+        table[i] = rand() % 256;
+    }
+    for (int i = 0; i < GANG_SIZE; i++) {
+        // includes out-of-table indices
+        in[i] = rand() % 160;
+    }
+
+#psim gang_size(GANG_SIZE)
+    {
+        uint32_t lane = psim_get_lane_num();
+
+        // 128-entry table lookup, data-dependent index
+        uint8_t lo = table[lane];
+        uint8_t hi = table[GANG_SIZE + lane];
+        lookup[lane] = psim_shuffle_sync<uint8_t>(lo, hi, (int)in[lane]);
+
+        // bit-reversal permutation of 32-bit values
+        uint32_t r = 0;
+        for (int b = 0; b < 6; b++) {
+            r |= ((lane >> b) & 1) << (5 - b);
+        }
+        rev[lane] = psim_shuffle_sync<int32_t>((int32_t)lane * 3, (int)r);
+    }
+
+    for (int i = 0; i < GANG_SIZE; i++) {
+        uint8_t ref = in[i] < 2 * GANG_SIZE ? table[in[i]] : 0;
+        uint32_t r = 0;
+        for (int b = 0; b < 6; b++) {
+            r |= ((i >> b) & 1) << (5 - b);
+        }
+        if (lookup[i] != ref || rev[i] != (int32_t)r * 3) {
+            printf("Fail! at %d: %d %d, expected %d %d\n", i, lookup[i],
+                   rev[i], ref, r * 3);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+
+int in[NELEM * 3];
+int out[NELEM];
+
+// The stride is only known at runtime: psv emits a unit-stride version and
+// keeps the gather version as fallback
+__attribute__((noinline)) void strided_copy(int* dst, const int* src,
+                                            int stride) {
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        dst[i] = src[i * stride] + 1;
+    }
+}
+
+int main() {
+    for (int i = 0; i < NELEM * 3; i++) {
+        in[i] = i * 5;
+    }
+
+    for (int stride = 0; stride <= 3; stride++) {
+        strided_copy(out, in, stride);
+        for (int i = 0; i < NELEM; i++) {
+            if (out[i] != in[i * stride] + 1) {
+                printf("Fail! stride %d: out[%d] = %d, expected %d\n", stride,
+                       i, out[i], in[i * stride] + 1);
+                exit(2);
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
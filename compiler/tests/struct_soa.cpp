@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+
+// private structs whose fields are indexed with a runtime index stay in
+// memory, and are laid out as one array of lanes per field
+struct Hit {
+    double t;
+    int id;
+    float n[3];
+};
+
+// 20 bytes of fields and 4 bytes of tail padding, which the struct of arrays
+// layout drops
+struct Sample {
+    double w;
+    int n[3];
+};
+
+int main() {
+    float out[NELEM];
+    int ids[NELEM];
+    int counts[NELEM];
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        Hit hit;
+        hit.t = i * 0.5;
+        hit.id = i;
+        for (int k = 0; k < 3; k++) {
+            hit.n[k] = i + k;
+        }
+        int k = i % 3;
+        out[i] = hit.n[k] + (float)hit.t;
+        ids[i] = hit.id;
+
+        // zero-initialized with a memset of the whole struct
+        Sample sample = {};
+        sample.n[i % 3] = i;
+        sample.w = 1.0;
+        counts[i] = sample.n[0] + sample.n[1] + sample.n[2] + (int)sample.w;
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        float expected = i + i % 3 + i * 0.5f;
+        if (out[i] != expected || ids[i] != i) {
+            printf("Fail! out[%d] = %f, ids[%d] = %d, expected %f, %d\n", i,
+                   out[i], i, ids[i], expected, i);
+            exit(2);
+        }
+        if (counts[i] != i + 1) {
+            printf("Fail! counts[%d] = %d, expected %d\n", i, counts[i], i + 1);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define NITER 20
+
+int main() {
+    int a[NELEM];
+    int b[NELEM];
+    // the gang size of each launch, which the head and tail gangs depend on
+    unsigned gang_size_a[NITER];
+    unsigned gang_size_b[NITER];
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = 0;
+        b[i] = 0;
+    }
+
+    // enough launches to time every candidate and run the pinned one
+    for (int iter = 0; iter < NITER; iter++) {
+#psim num_spmd_threads(NELEM) gang_size(auto)
+        {
+            uint64_t i = psim_get_thread_num();
+            a[i] += i + psim_is_head_gang();
+            if (i == 0) {
+                gang_size_a[iter] = psim_get_gang_size();
+            }
+        }
+
+#psim parallel num_spmd_threads(NELEM) gang_size(8, 32)
+        {
+            uint64_t i = psim_get_thread_num();
+            b[i] += 2 * i + psim_is_tail_gang();
+            if (i == 0) {
+                gang_size_b[iter] = psim_get_gang_size();
+            }
+        }
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        int ref_a = 0;
+        int ref_b = 0;
+        for (int iter = 0; iter < NITER; iter++) {
+            int head_end = gang_size_a[iter];
+            int tail_begin = (NELEM - 1) / gang_size_b[iter];
+            tail_begin *= gang_size_b[iter];
+            ref_a += i + (i < head_end);
+            ref_b += 2 * i + (i >= tail_begin);
+        }
+        if (a[i] != ref_a) {
+            printf("Fail! a[%d] = %d, expected %d\n", i, a[i], ref_a);
+            exit(2);
+        }
+        if (b[i] != ref_b) {
+            printf("Fail! b[%d] = %d, expected %d\n", i, b[i], ref_b);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
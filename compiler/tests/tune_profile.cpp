@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define NELEM 1000
+#define NITER 10
+#define PROFILE "bin/tune_profile.txt"
+#define SITE "dir with spaces/\"quoted\".cpp:12"
+
+void fail(const char* msg) {
+    printf("Fail! %s\n", msg);
+    exit(2);
+}
+
+int main() {
+    // the last line of a site wins, malformed lines are skipped
+    FILE* f = fopen(PROFILE, "w");
+    fprintf(f, "other.cpp:1 32\n");
+    fprintf(f, "%s 16\n", SITE);
+    fprintf(f, "%s 8\n", SITE);
+    fprintf(f, "%s\n", SITE);
+    fprintf(f, "%s 8x\n", SITE);
+    fclose(f);
+    setenv("PSIM_TUNE_FILE", PROFILE, 1);
+
+    PsimTuner read(SITE, {32, 8, 16});
+    for (int n = 0; n < NITER; n++) {
+        if (read.select() != 1) {
+            fail("the profile was not read back");
+        }
+    }
+
+    // the pinned gang size is appended and read back by the next run
+    PsimTuner write(SITE "0", {8, 16});
+    for (int n = 0; n < 2 * PSIM_TUNE_TRIALS; n++) {
+        unsigned variant = write.select();
+        write.record(variant, PsimTuner::start(), NELEM);
+    }
+    PsimTuner reread(SITE "0", {8, 16});
+    if (reread.select() != write.select()) {
+        fail("the pinned gang size was not written");
+    }
+
+    int a[NELEM] = {};
+    for (int iter = 0; iter < NITER; iter++) {
+#psim num_spmd_threads(NELEM) gang_size(8, 16)
+        {
+            uint64_t i = psim_get_thread_num();
+            a[i] += i;
+        }
+    }
+    for (int i = 0; i < NELEM; i++) {
+        if (a[i] != NITER * i) {
+            fail("wrong result of the tuned region");
+        }
+    }
+
+    // the region appended the last line
+    char line[4096] = {};
+    f = fopen(PROFILE, "r");
+    while (fgets(line, sizeof(line), f)) {
+    }
+    fclose(f);
+    if (!strstr(line, "tune_profile.cpp:") ||
+        (!strstr(line, " 8\n") && !strstr(line, " 16\n"))) {
+        fail("the region did not write its profile");
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define NFUNCS 16
+
+// math functions mapped to LLVM intrinsics, Sleef or the in-tree vector
+// math library, checked against libm with a relative tolerance
+bool compare_float(float x, float y) {
+    if (x == y || std::isnan(y)) {
+        return x == y || std::isnan(x);
+    }
+    return std::fabs(x - y) <= 1e-5f * std::fmax(1.0f, std::fabs(y));
+}
+
+int main() {
+    float a[NELEM];
+    float b[NELEM];
+    float out[NFUNCS][NELEM];
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = (i - NELEM / 2) * 0.037f;
+        b[i] = (i % 17) * 0.25f - 2.0f;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16)
+    {
+        uint64_t i = psim_get_thread_num();
+        float x = a[i];
+        float y = b[i];
+        out[0][i] = floorf(x);
+        out[1][i] = fminf(x, y);
+        out[2][i] = fmaf(x, y, 1.0f);
+        out[3][i] = expf(x);
+        out[4][i] = exp2f(y);
+        out[5][i] = logf(fabsf(x));
+        out[6][i] = log2f(fabsf(x));
+        out[7][i] = powf(fabsf(x), y);
+        out[8][i] = sinf(x);
+        out[9][i] = cosf(x);
+        out[10][i] = tanf(x);
+        out[11][i] = atanf(x);
+        out[12][i] = atan2f(y, x);
+        out[13][i] = asinf(y * 0.5f);
+        out[14][i] = tanhf(x);
+        out[15][i] = coshf(y);
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        float x = a[i];
+        float y = b[i];
+        float ref[NFUNCS] = {floorf(x),          fminf(x, y),
+                             fmaf(x, y, 1.0f),   expf(x),
+                             exp2f(y),           logf(fabsf(x)),
+                             log2f(fabsf(x)),    powf(fabsf(x), y),
+                             sinf(x),            cosf(x),
+                             tanf(x),            atanf(x),
+                             atan2f(y, x),       asinf(y * 0.5f),
+                             tanhf(x),           coshf(y)};
+        for (int j = 0; j < NFUNCS; j++) {
+            if (!compare_float(out[j][i], ref[j])) {
+                printf("Fail! function %d (%f, %f): %.9g, expected %.9g\n", j,
+                       x, y, out[j][i], ref[j]);
+                exit(2);
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
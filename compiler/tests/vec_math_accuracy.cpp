@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1003
+#define NFUNCS 8
+
+// math(fast) and math(approx) regions, checked against libm with the
+// relative tolerance of their accuracy
+bool compare_float(float x, float y, float tolerance) {
+    return std::fabs(x - y) <= tolerance * std::fmax(1.0f, std::fabs(y));
+}
+
+// cloned for the regions that call it, once per accuracy: the math(precise)
+// region must not reuse the clone of the math(approx) region, which doesn't
+// handle infinities
+__attribute__((noinline)) float exp_helper(float x) { return expf(x); }
+
+int main() {
+    float a[NELEM];
+    float b[NELEM];
+    float fast[NFUNCS][NELEM];
+    float approx[NFUNCS][NELEM];
+    float helper_approx[NELEM];
+    float helper_precise[NELEM];
+
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = (i - NELEM / 2) * 0.037f;
+        b[i] = (i % 17) * 0.25f - 2.0f;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16) math(fast)
+    {
+        uint64_t i = psim_get_thread_num();
+        float x = a[i];
+        float y = b[i];
+        fast[0][i] = expf(x);
+        fast[1][i] = logf(fabsf(x) + 0.5f);
+        fast[2][i] = powf(fabsf(x) + 0.5f, y);
+        fast[3][i] = sinf(x);
+        fast[4][i] = cosf(x);
+        fast[5][i] = tanf(y);
+        fast[6][i] = atan2f(y, x);
+        fast[7][i] = tanhf(x);
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16) math(approx)
+    {
+        uint64_t i = psim_get_thread_num();
+        float x = a[i];
+        float y = b[i];
+        approx[0][i] = expf(x);
+        approx[1][i] = logf(fabsf(x) + 0.5f);
+        approx[2][i] = powf(fabsf(x) + 0.5f, y);
+        approx[3][i] = sinf(x);
+        approx[4][i] = cosf(x);
+        approx[5][i] = tanf(y);
+        approx[6][i] = atan2f(y, x);
+        approx[7][i] = tanhf(x);
+        helper_approx[i] = exp_helper(x);
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(16) math(precise)
+    {
+        uint64_t i = psim_get_thread_num();
+        helper_precise[i] = exp_helper(a[i] * 10.0f);
+    }
+
+    for (int i = 0; i < NELEM; i++) {
+        float x = a[i];
+        float y = b[i];
+        float ref[NFUNCS] = {expf(x),
+                             logf(fabsf(x) + 0.5f),
+                             powf(fabsf(x) + 0.5f, y),
+                             sinf(x),
+                             cosf(x),
+                             tanf(y),
+                             atan2f(y, x),
+                             tanhf(x)};
+        for (int j = 0; j < NFUNCS; j++) {
+            if (!compare_float(fast[j][i], ref[j], 1e-5f)) {
+                printf("Fail! math(fast) function %d (%f, %f): %.9g, "
+                       "expected %.9g\n",
+                       j, x, y, fast[j][i], ref[j]);
+                exit(2);
+            }
+            if (!compare_float(approx[j][i], ref[j], 1e-4f)) {
+                printf("Fail! math(approx) function %d (%f, %f): %.9g, "
+                       "expected %.9g\n",
+                       j, x, y, approx[j][i], ref[j]);
+                exit(2);
+            }
+        }
+        if (!compare_float(helper_approx[i], expf(x), 1e-4f)) {
+            printf("Fail! math(approx) exp_helper(%f): %.9g, expected %.9g\n",
+                   x, helper_approx[i], expf(x));
+            exit(2);
+        }
+        float ref = expf(x * 10.0f);
+        if (std::isinf(ref) ? helper_precise[i] != ref
+                            : !compare_float(helper_precise[i], ref, 1e-6f)) {
+            printf("Fail! math(precise) exp_helper(%f): %.9g, expected %.9g\n",
+                   x * 10.0f, helper_precise[i], ref);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+#define GANG_SIZE 32
+#define NGANGS ((NELEM + GANG_SIZE - 1) / GANG_SIZE)
+
+uint8_t a[NELEM];
+uint64_t ballot[NGANGS];
+uint32_t popc[NGANGS];
+uint32_t first[NGANGS];
+uint8_t any[NGANGS];
+uint8_t all[NGANGS];
+
+int main() {
+    for (int g = 0; g < NGANGS; g++) {
+        first[g] = GANG_SIZE;
+    }
+    for (int i = 0; i < NELEM; i++) {
+        // some gangs with no odd value, some with only odd values
+        int g = i / GANG_SIZE;
+        a[i] = g % 4 == 0 ? 2 : g % 4 == 1 ? 1 : rand() % 256;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(GANG_SIZE)
+    {
+        uint64_t i = psim_get_thread_num();
+        uint64_t g = psim_get_gang_num();
+        bool odd = a[i] & 1;
+        ballot[g] = psim_ballot_sync(odd);
+        popc[g] = psim_popc_sync(odd);
+        any[g] = psim_any_sync(odd);
+        all[g] = psim_all_sync(odd);
+        if (a[i] > 100) {
+            first[g] = psim_first_active_lane();
+        }
+    }
+
+    for (int g = 0; g < NGANGS; g++) {
+        uint64_t ref_ballot = 0;
+        uint32_t ref_first = GANG_SIZE;
+        bool ref_all = true;
+        for (int l = 0; l < GANG_SIZE && g * GANG_SIZE + l < NELEM; l++) {
+            uint8_t v = a[g * GANG_SIZE + l];
+            ref_ballot |= (uint64_t)(v & 1) << l;
+            ref_all = ref_all && (v & 1);
+            if (v > 100 && ref_first == GANG_SIZE) {
+                ref_first = l;
+            }
+        }
+        if (ballot[g] != ref_ballot ||
+            popc[g] != (uint32_t)__builtin_popcountll(ref_ballot) ||
+            any[g] != (ref_ballot != 0) || all[g] != ref_all ||
+            first[g] != ref_first) {
+            printf("Fail! gang %d\n", g);
+            exit(2);
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
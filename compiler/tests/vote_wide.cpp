@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <parsim.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define NELEM 1000
+#define GANG_SIZE 128
+#define NGANGS ((NELEM + GANG_SIZE - 1) / GANG_SIZE)
+// the words of the bitmap of a gang, plus one past the end, which is empty
+#define NWORDS (GANG_SIZE / 64 + 1)
+
+uint8_t a[NELEM];
+uint64_t ballot[NGANGS][NWORDS];
+
+int main() {
+    for (int i = 0; i < NELEM; i++) {
+        a[i] = rand() % 256;
+    }
+
+#psim num_spmd_threads(NELEM) gang_size(GANG_SIZE)
+    {
+        uint64_t i = psim_get_thread_num();
+        uint64_t g = psim_get_gang_num();
+        bool odd = a[i] & 1;
+        for (unsigned w = 0; w < NWORDS; w++) {
+            ballot[g][w] = psim_ballot_sync(odd, w);
+        }
+    }
+
+    for (int g = 0; g < NGANGS; g++) {
+        uint64_t ref_ballot[NWORDS] = {};
+        for (int l = 0; l < GANG_SIZE && g * GANG_SIZE + l < NELEM; l++) {
+            uint8_t v = a[g * GANG_SIZE + l];
+            ref_ballot[l / 64] |= (uint64_t)(v & 1) << (l % 64);
+        }
+        for (int w = 0; w < NWORDS; w++) {
+            if (ballot[g][w] != ref_ballot[w]) {
+                printf("Fail! gang %d word %d\n", g, w);
+                exit(2);
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}